@@ -0,0 +1,27 @@
+#ifndef __ACTIONS_H_
+#define __ACTIONS_H_
+
+#include <horizonwm_type_definitions.h>
+
+//Key and button actions made of several steps, run in order without blocking the WM.
+//A spawn step waits for the program to exit (spawn_async), the next step runs from the event loop then.
+//  static const ActionStep kbd_up[] = {ACTION_SPAWN(KBupbrightnesscmd), ACTION_REFRESH(BAR_MODULE_BRIGHTNESS), ACTION_END};
+//  { 0, XF86XK_KbdBrightnessUp, run_action, {.v = kbd_up} },
+enum {ActionEnd, ActionSpawn, ActionCall, ActionRefresh};
+
+typedef struct ActionStep {
+  int type;
+  void (*func)(const Arg *);              //ActionCall
+  Arg arg;                                //Command (ActionSpawn), argument (ActionCall) or module id (ActionRefresh)
+} ActionStep;
+
+#define ACTION_SPAWN(cmd)       {ActionSpawn,   NULL, {.v = cmd}}
+#define ACTION_CALL(f, ...)     {ActionCall,    f,    __VA_ARGS__}
+#define ACTION_REFRESH(id)      {ActionRefresh, NULL, {.ui = id}}   //Only that module. 0: every one
+#define ACTION_END              {ActionEnd,     NULL, {0}}
+
+#define ACTION_MAX_RUNNING      8         //Chains waiting for a program at once
+
+void run_action(const Arg *a);            //Main thread. a->v: ActionStep[], ACTION_END terminated
+
+#endif //_ACTIONS_H_
@@ -0,0 +1,23 @@
+#ifndef __BACKLIGHT_H_
+#define __BACKLIGHT_H_
+
+#include <stdbool.h>
+
+#define BACKLIGHT_EXPONENT        2.0   //Perceptual steps: brightness = max * (percent / 100)^exponent. 1.0 is linear
+#define BACKLIGHT_MIN_PERCENT     1     //Steps down never turn the panel off
+#define BACKLIGHT_FADE_MS         120   //Fade duration of every change. 0 sets it at once
+#define BACKLIGHT_FADE_TICK_MS    15
+#define BACKLIGHT_EXPECT_TIMEOUT  1     //Seconds an expected brightness is shown if the real one doesn't change
+
+//Writes the brightness attribute of the preferred backlight (power_supply.h) through a file
+//descriptor kept open, fading with a timerfd on the main loop. When it isn't writable (no udev rule
+//for the video group), the value is set through logind's Session.SetBrightness instead, without fades.
+int  backlight_control_init(void);      //Main thread. After power_supply_discover() and event_loop_init(). -1 if no backlight
+int  backlight_step(int delta);         //Main thread. Percent, from the current target. -1 if it can't be changed
+int  backlight_set_percent(int percent);
+
+int  backlight_percent(void);           //Perceptual percent. Target of a running change. -1 if there is no backlight
+void backlight_expect(int percent);     //Shown by backlight_percent() until the real brightness changes (external tools)
+void backlight_invalidate(void);        //Rereads the brightness on next access
+
+#endif //_BACKLIGHT_H_
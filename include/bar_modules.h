@@ -2,8 +2,17 @@
 #define __BAR_MODULES_H_
 
 #include <stdlib.h>
+#include <stdbool.h>
 
-enum {BAR_DEFAULT_MODULE, BAR_MODULE_DATE, BAR_MODULE_KEYBOARDMAPPING, BAR_MODULE_BATTERYSTATUS, BAR_MODULE_BRIGHTNESS, BAR_MODULE_VOLUME, BAR_MODULE_UPDATES, BAR_MODULE_OPENVPN, BAR_MODULE_WMMODE, BAR_MODULE_WIRELESS, BAR_MODULE_WIRED, BAR_MODULE_MPC};
+enum {BAR_DEFAULT_MODULE, BAR_MODULE_DATE, BAR_MODULE_KEYBOARDMAPPING, BAR_MODULE_BATTERYSTATUS, BAR_MODULE_BRIGHTNESS, BAR_MODULE_VOLUME, BAR_MODULE_UPDATES, BAR_MODULE_OPENVPN, BAR_MODULE_WMMODE, BAR_MODULE_WIRELESS, BAR_MODULE_WIRED, BAR_MODULE_MPC, BAR_MODULE_CPU, BAR_MODULE_MEMORY, BAR_MODULE_NETWORK, BAR_MODULE_DISK, BAR_MODULE_TEMPERATURE, BAR_MODULE_STATUSFEED};
+
+#define BAR_DATE_SECONDS  0     //Show seconds in the date module
+#define BAR_DATE_PERIOD   (BAR_DATE_SECONDS ? 1 : 60)
+#define BAR_SYSMON_PERIOD 5     //CPU, memory, network, disk and temperature. Rates are averaged over it
+
+//Redraws this close together reuse the command output (command_cache.h)
+#define OPENVPN_STATUS_TTL_MS 5000
+#define PAMIXER_TTL_MS        250
 
 #define BAR_MODULE_ARGUMENTS int bufsize, char *retstring, void *args, char *color
 
@@ -18,6 +27,14 @@ int openvpn_barmodule(BAR_MODULE_ARGUMENTS);
 int wm_mode_barmodule(BAR_MODULE_ARGUMENTS);
 int wireless_barmodule(BAR_MODULE_ARGUMENTS);
 int wired_connection_barmodule(BAR_MODULE_ARGUMENTS);
+int status_feed_barmodule(BAR_MODULE_ARGUMENTS);
+
+//System monitor:
+int cpu_barmodule(BAR_MODULE_ARGUMENTS);
+int memory_barmodule(BAR_MODULE_ARGUMENTS);
+int network_barmodule(BAR_MODULE_ARGUMENTS);
+int disk_barmodule(BAR_MODULE_ARGUMENTS);
+int temperature_barmodule(BAR_MODULE_ARGUMENTS);
 
 //MPD:
 int mpd_status_barmodule(BAR_MODULE_ARGUMENTS);
@@ -27,21 +44,27 @@ int mpd_stop_barmodule(BAR_MODULE_ARGUMENTS);
 int mpd_next_barmodule(BAR_MODULE_ARGUMENTS);
 
 
+//Volume without PulseAudio, as pamixer last read it. Changes not applied yet are shown at once,
+//pamixer reads don't replace them until volume_expect_clear()
+void volume_expect(int delta);      //Percent, clamped
+void volume_expect_mute(void);      //Toggles it
+void volume_expect_clear(void);     //Reconciled, the next pamixer read shows the real state
+
 //On bar module clicked functions:
-int volume_clicked(int mask, int button);
-int keyboard_mapping_clicked(int mask, int button);
-int updates_clicked(int mask, int button);
-int brightness_clicked(int mask, int button);
+int volume_clicked(int mask, int button, int clicks);
+int keyboard_mapping_clicked(int mask, int button, int clicks);
+int updates_clicked(int mask, int button, int clicks);
+int brightness_clicked(int mask, int button, int clicks);
 
 //MPD Clicked:
-int mpd_status_clicked(int mask, int button);
-int mpd_prev_clicked(int mask, int button);
-int mpd_playpause_clicked(int mask, int button);
-int mpd_stop_clicked(int mask, int button);
-int mpd_next_clicked(int mask, int button);
+int mpd_status_clicked(int mask, int button, int clicks);
+int mpd_prev_clicked(int mask, int button, int clicks);
+int mpd_playpause_clicked(int mask, int button, int clicks);
+int mpd_stop_clicked(int mask, int button, int clicks);
+int mpd_next_clicked(int mask, int button, int clicks);
 
 typedef int  (*BarModuleFunction)(BAR_MODULE_ARGUMENTS);
-typedef int (*BarModuleButtonFunction)(int, int);
+typedef int (*BarModuleButtonFunction)(int, int, int);   //mask, button, times clicked: wheel scrolls that queued up come in one call
 
 typedef struct BarModule {
   BarModuleFunction       function;
@@ -52,5 +75,25 @@ typedef struct BarModule {
 } BarModule;
 
 extern BarModule bar_modules[];
+unsigned int bar_modules_mask(unsigned int id);     //bar_modules[] index bits of every module with that id
+const char *bar_module_name(unsigned int id);       //Static string, for statistics
+
+#define BAR_MAX_MODULES       32
+#define BAR_MODULE_TEXTLEN    256
+
+//Last output of each module (same index as bar_modules[]). Painting only happens when serial changes
+typedef struct BarModuleOutput {
+  char text[BAR_MODULE_TEXTLEN];
+  char color[8];
+  int textw;                  //Shaped text width, only measured again when text changes
+  unsigned int serial;        //Incremented whenever text or color change
+  int right;                  //Layout: distance from the right edge of the bar
+  int drawwidth;
+  bool separator;             //Separator drawn at its left
+} BarModuleOutput;
+
+extern BarModuleOutput bar_modules_output[BAR_MAX_MODULES];
+extern unsigned long bar_module_repaints;           //Modules painted
+extern unsigned long bar_module_repaints_skipped;   //Modules left untouched because their output didn't change
 
 #endif //_BAR_MODULES_H_
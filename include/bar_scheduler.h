@@ -0,0 +1,15 @@
+#ifndef __BAR_SCHEDULER_H_
+#define __BAR_SCHEDULER_H_
+
+#include <time.h>
+#include <stdbool.h>
+
+//Refreshes every module with a period on the wall clock multiples of it (date on the minute...),
+//using a single timerfd armed at the earliest deadline. Modules with period 0 only refresh on events.
+//The timer is rearmed when the clock is set or the machine resumes (TFD_TIMER_CANCEL_ON_SET).
+//Periods are scaled by the power policy (power_policy.h), except the clock.
+int  bar_scheduler_init(void);          //Main thread. Returns -1 if there is no timerfd
+void bar_scheduler_rearm(void);         //Periods changed, recompute every deadline
+void bar_scheduler_pause(bool pause);   //Disarms the timer while nothing should refresh. Unpausing rearms it
+
+#endif //_BAR_SCHEDULER_H_
@@ -0,0 +1,24 @@
+#ifndef __CHILDREN_H_
+#define __CHILDREN_H_
+
+#include <sys/types.h>
+
+//Children of the WM itself (the launcher, and programs started while it is down) are reaped from the main
+//loop, through a signalfd. Each one is handed to whoever registered its pid, with its resource usage (wait4).
+//Nobody else calls waitpid(), so no waiter can lose its child to another.
+#define CHILDREN_MAX_WATCHED    64
+#define CHILDREN_MAX_UNCLAIMED  32        //Exits kept for waiters that register after the child is gone
+
+typedef struct ChildUsage {
+  long long utime_us;                     //User CPU time
+  long long stime_us;                     //System CPU time
+  long maxrss_kb;                         //Peak resident set size
+} ChildUsage;
+
+typedef void (*ChildExited)(pid_t pid, int status, const ChildUsage *usage, void *data);
+
+void children_init(void);                 //Main thread, before any other thread exists
+int  children_watch(pid_t pid, ChildExited exited, void *data);   //Main thread. exited() is called from the main loop
+int  children_wait(pid_t pid, ChildUsage *usage);                 //Thread safe, blocks. Wait status, or -1
+
+#endif //_CHILDREN_H_
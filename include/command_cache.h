@@ -0,0 +1,20 @@
+#ifndef __COMMAND_CACHE_H_
+#define __COMMAND_CACHE_H_
+
+#include <stddef.h>
+#include <spawn_programs.h>
+
+#define COMMAND_CACHE_ENTRIES     16
+#define COMMAND_CACHE_KEYLEN      256     //Longer command lines aren't cached
+#define COMMAND_CACHE_OUTPUT      SPAWN_ASYNC_MAX_OUTPUT
+#define COMMAND_CACHE_MAX_WAITERS 8       //Asynchronous callers sharing one run
+
+//Output of commands, keyed by argv. A command runs at most once at a time: callers asking for it while
+//it runs share that run. Its result is then reused for ttl_ms.
+//Blocking, for threads. Returns the wait status, or -1
+int  command_cache_output(const char *const argv[], unsigned int ttl_ms, char *buf, size_t size);
+//Main thread. done() is called right away if the result is fresh, else once it is. -1 if it couldn't run
+int  command_cache_async(const char *const argv[], unsigned int ttl_ms, SpawnDone done, void *data);
+void command_cache_invalidate(const char *const argv[]);  //Thread safe. The next caller runs it again
+
+#endif //_COMMAND_CACHE_H_
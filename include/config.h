@@ -5,6 +5,8 @@
 #include <spawn_programs.h>
 #include <helper_scripts.h>
 #include <menu_scripts.h>
+#include <actions.h>
+#include <bar_modules.h>
 #include <X11/XF86keysym.h>
 
 //Borders and gaps
@@ -21,7 +23,6 @@ static const int showbar            = 1;       //0 means no bar
 static const int bar_lobar          = 3;       //Thickness of bar color details (bottom)
 static const int bar_hibar          = 0;       //Thickness of bar color details (bottom)
 static const int topbar             = 1;       //0=bottom bar, 1=top bar
-static const int bar_sleeptime      = 5;       //Seconds. 0 or negative means dont update
 static const int bar_alpha          = 0xcc;    //Bar opacity 80%
 
 //Fonts
@@ -119,6 +120,18 @@ static const Layout layouts[] = {
 /* helper for spawning shell commands in the pre dwm-5.0 fashion */
 #define SHCMD(cmd) { .v = (const char*[]){ "/bin/sh", "-c", cmd, NULL } }
 
+//Several steps for one key (actions.h)
+static const ActionStep toggle_updates_action[] = {
+  ACTION_CALL(toggle_update_checks, {0}),
+  ACTION_REFRESH(BAR_MODULE_UPDATES),
+  ACTION_END
+};
+static const ActionStep wm_mode_action[] = {
+  ACTION_CALL(switch_wm_mode, {0}),
+  ACTION_REFRESH(BAR_MODULE_WMMODE),
+  ACTION_END
+};
+
 static const Key keys[] = {
 	/* modifier                     key        function        argument */
 	{ MODKEY,                       XK_d,      spawn,          {.v = roficmd } },
@@ -128,22 +141,15 @@ static const Key keys[] = {
 	{ MODKEY,                       XK_x,      spawn,          {.v = claviscmd } },
 
   //  ##### Function keys #####
-  //Volume
-  { 0,                            XF86XK_AudioRaiseVolume,    spawn_waitpid,                 {.v = upvolumecmd}          },
-  { 0,                            XF86XK_AudioLowerVolume,    spawn_waitpid,                 {.v = downvolume}           },
-  { 0,                            XF86XK_AudioMute,           spawn_waitpid,                 {.v = mutevolume}           },
-  //Volume (update bar)
-  { 0,                            XF86XK_AudioRaiseVolume,    drawbars_caller_with_arg,      {0}                         },
-  { 0,                            XF86XK_AudioLowerVolume,    drawbars_caller_with_arg,      {0}                         },
-  { 0,                            XF86XK_AudioMute,           drawbars_caller_with_arg,      {0}                         },
-  //Monitor
-  { 0,                            XF86XK_MonBrightnessDown,   spawn_waitpid,                 {.v = downbrightnesscmd}    },
-  { 0,                            XF86XK_MonBrightnessUp,     spawn_waitpid,                 {.v = upbrightnesscmd}      },
-  { 0,                            XF86XK_ScreenSaver,         spawn_waitpid,                 {.v = monitoroffcmd}        },
-  //Monitor (update bar)
-  { 0,                            XF86XK_MonBrightnessDown,   drawbars_caller_with_arg,      {0}                         },
-  { 0,                            XF86XK_MonBrightnessUp,     drawbars_caller_with_arg,      {0}                         },
-  { 0,                            XF86XK_ScreenSaver,         drawbars_caller_with_arg,      {0}                         },
+  //Volume (bar is updated by the PulseAudio subscription)
+  { 0,                            XF86XK_AudioRaiseVolume,    change_volume,                 {.i = +5}                   },
+  { 0,                            XF86XK_AudioLowerVolume,    change_volume,                 {.i = -5}                   },
+  { 0,                            XF86XK_AudioMute,           toggle_mute,                   {0}                         },
+  //Monitor (bar shows the expected brightness right away)
+  { 0,                            XF86XK_MonBrightnessDown,   change_brightness,             {.i = -5}                   },
+  { 0,                            XF86XK_MonBrightnessUp,     change_brightness,             {.i = +5}                   },
+  //Monitor (bar is redrawn when the display wakes up)
+  { 0,                            XF86XK_ScreenSaver,         monitor_off,                   {0}                         },
   //KBD light
   { 0,                            XF86XK_KbdBrightnessDown,   spawn,                         {.v = KBdownbrightnesscmd}  },
   { 0,                            XF86XK_KbdBrightnessUp,     spawn,                         {.v = KBupbrightnesscmd}    },
@@ -152,11 +158,9 @@ static const Key keys[] = {
 
   { 0,                            XF86XK_Calculator,          spawn,                         {.v = calculatorcmd}        },
 
-  //Updates checker
-  { MODKEY,                       XK_u,                       toggle_update_checks,          {0}                         },
-  { MODKEY,                       XK_u,                       drawbars_caller_with_arg,      {0}                         },
+  //Updates checker (the check itself updates the bar)
+  { MODKEY,                       XK_u,                       run_action,                    {.v = toggle_updates_action}},
   { MODKEY|ShiftMask,             XK_u,                       async_check_updates_handler,   {0},                        },
-  { MODKEY|ShiftMask,             XK_u,                       drawbars_caller_with_arg,      {0},                        },
 
 	{ MODKEY,                       XK_n,                       togglebar,                     {0}                         },
 	{ MODKEY|ShiftMask,             XK_e,                       quit,                          {0}                         },
@@ -186,8 +190,7 @@ static const Key keys[] = {
 	{ MODKEY,                       XK_m,                       setlayout,                     {.v = &layouts[2]}          },
 	{ MODKEY,                       XK_space,                   setlayout,                     {0}                         },
 
-  { MODKEY|ShiftMask,             XK_m,                       switch_wm_mode,                {0}                         },
-  { MODKEY|ShiftMask,             XK_m,                       drawbars_caller_with_arg,      {0}                         },
+  { MODKEY|ShiftMask,             XK_m,                       run_action,                    {.v = wm_mode_action}       },
 
   //Gaps
 	{ MODKEY|ShiftMask,             XK_plus,                    modgaps,                       {.i = +5}                   },
@@ -212,21 +215,12 @@ static const Key keys[] = {
   //MPC CONTROLS
 	{ MODKEY,                       XK_KP_Up,                   spawn,                         {.v = mpc_volumeup }        },
 	{ MODKEY,                       XK_KP_Down,                 spawn,                         {.v = mpc_volumedown }      },
-	{ MODKEY,                       XK_KP_Begin,                spawn_waitpid,                 {.v = mpc_toggle }          },
-	{ MODKEY,                       XK_KP_Left,                 spawn_waitpid,                 {.v = mpc_prev }            },
-	{ MODKEY,                       XK_KP_Right,                spawn_waitpid,                 {.v = mpc_next }            },
-
-  { MODKEY,                       XK_KP_Begin,                setmpcstatus,                  {0}                         },
-  { MODKEY,                       XK_KP_Left,                 setmpcstatus,                  {0}                         },
-  { MODKEY,                       XK_KP_Right,                setmpcstatus,                  {0}                         },
-
-  { MODKEY,                       XK_KP_Begin,                drawbars_caller_with_arg,      {0}                         },
-  { MODKEY,                       XK_KP_Left,                 drawbars_caller_with_arg,      {0}                         },
-  { MODKEY,                       XK_KP_Right,                drawbars_caller_with_arg,      {0}                         },
+	{ MODKEY,                       XK_KP_Begin,                mpd_action,                    {.v = mpc_toggle }          },
+	{ MODKEY,                       XK_KP_Left,                 mpd_action,                    {.v = mpc_prev }            },
+	{ MODKEY,                       XK_KP_Right,                mpd_action,                    {.v = mpc_next }            },
 
-  //Keyboard mappings
+  //Keyboard mappings (bar is updated on XkbStateNotify)
   { ControlMask,                  XK_Menu,                    switch_keyboard_mapping,       {0}                         },
-  { ControlMask,                  XK_Menu,                    drawbars_caller_with_arg,      {0}                         },
 
 	{ 0,                            XK_Print,                   scripts_take_screenshot,       {.i = 0}                    },
 	{ ShiftMask,                    XK_Print,                   scripts_take_screenshot,       {.i = 1}                    },
@@ -0,0 +1,30 @@
+#ifndef __DISPLAY_STATE_H_
+#define __DISPLAY_STATE_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <X11/Xlib.h>
+
+#define DISPLAY_BLANKED_POLL  2       //Seconds between DPMS checks while blanked, to notice the wake up
+#define DISPLAY_AWAKE_POLL    60      //Longest time between DPMS checks while awake
+
+//The display is blanked while the screen saver is active (MIT-SCREEN-SAVER), the monitors are not
+//DPMS On, or a screen locker we spawned is running. Nobody sees the bar then, so nothing refreshes it.
+//Same while no monitor shows its bar (hidden with togglebar or covered by a fullscreen client).
+int  display_state_init(Display *dpy, Window root);   //Main thread. Returns the ScreenSaverNotify event type or -1
+void display_state_event(XEvent *e);                  //Main thread. ScreenSaverNotify
+void display_state_check(void);                       //Main thread. Queries DPMS and the locker now
+
+void display_state_set_bars_hidden(bool hidden);      //Main thread. No monitor shows its bar
+
+bool display_awake(void);                             //Somebody can see the bar
+void display_state_poll_soon(void);                   //Thread safe. Something may have blanked the display
+void display_state_set_locker(pid_t pid);             //Thread safe. Blanked until pid exits
+
+//For polling threads, instead of sleep(). Returns after seconds, but never while the bar is unseen,
+//and right away when it is seen again so the thread refreshes immediately.
+//The duration is scaled by the power policy, and sleeping threads follow policy changes.
+void display_sleep(unsigned int seconds);
+void display_sleep_reschedule(void);                  //Thread safe. Sleeping threads recompute their deadline
+
+#endif //_DISPLAY_STATE_H_
@@ -0,0 +1,25 @@
+#ifndef __EVENT_LOOP_H_
+#define __EVENT_LOOP_H_
+
+#include <poll.h>
+#include <stdbool.h>
+
+#define EVENT_LOOP_MAX_WATCHES 48
+
+typedef void (*EventLoopFunction)(int fd, short revents, void *data);
+
+void event_loop_init(void);               //Must be called before any thread can request a redraw
+
+//Watched file descriptors. Must only be called from the main thread.
+int  event_loop_watch(int fd, short events, EventLoopFunction function, void *data);
+void event_loop_unwatch(int fd);
+
+//Blocks until the X connection or any watched fd is readable. Dispatches watched fds.
+void event_loop_wait(int xfd);
+
+//Thread safe. Wakes up the main loop, which will then redraw the bars once.
+void request_drawbars(void);                          //Every module is run again
+void request_drawbars_modules(unsigned int modules);  //Only the modules in the mask (bar_modules[] index bits)
+unsigned int event_loop_redraw_pending(void);         //Returns and clears the pending module mask
+
+#endif //_EVENT_LOOP_H_
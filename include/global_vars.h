@@ -22,6 +22,7 @@ extern int mpd_status;
 extern char mpd_song[128];
 extern char mpd_songduration[64];
 extern char mpd_percentage[8];
+extern int mpd_actions_pending;         //mpc commands still running. Their expected state is shown meanwhile
 
 extern int n_updates_pacman;
 extern int n_updates_aur;
@@ -1,6 +1,9 @@
 #ifndef __HELPER_SCRIPTS_H_
 #define __HELPER_SCRIPTS_H_
 
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
 #include <horizonwm_type_definitions.h>
 
 void notify_send(const char *title, const char *text);
@@ -9,8 +12,22 @@ void notify_send_timeout(const char *title, const char *text, int timeout);
 void notify_send_timeout_critical(const char *title, const char *text, int timeout);
 
 void scripts_take_screenshot(const Arg *a);
-void scripts_set_keyboard_mapping(const Arg *a);
-
+void scripts_load_keyboard_mappings();
+
+//Batched reads of already open files. Uses io_uring when built with it (make IO_URING=1), pread() otherwise
+typedef struct ReadRequest {
+  int fd;
+  char *buf;
+  size_t len;
+  off_t offset;
+  bool no_ring;       //Always pread(). io_uring punts files generated on read (/proc) to a worker thread
+  ssize_t result;     //Bytes read, or -errno
+} ReadRequest;
+
+int read_batch(ReadRequest *reqs, int n);   //Returns number of successful reads
+bool read_batch_uses_io_uring(void);
+
+int read_file_string(const char *file, char *buf, size_t size);
 float read_file_float(const char *file);
 int read_file_int(const char *file);
 
@@ -18,8 +35,22 @@ int percentage_to_progressbar(char *buffer, int pctg, int len);
 
 void switch_keyboard_mapping();
 
+void monitor_off(const Arg *a);       //DPMS off. Bar refresh stops until the monitors wake up
+void lock_screen(const Arg *a);
+
+//Optimistic: the bar shows the expected result at once, the command runs through spawn_async()
+//and its exit refreshes the module with the real state, from the event loop. Main thread only.
+//Volume (without PulseAudio) and brightness steps are coalesced: one command at a time, carrying the
+//sum of every step requested within ADJUST_COALESCE_MS or while the previous one ran
+#define ADJUST_COALESCE_MS    40
+void change_volume(const Arg *a);     //a->i is the delta in percent
+void toggle_mute(const Arg *a);
+void change_brightness(const Arg *a); //a->i is the delta in percent
+void mpd_action(const Arg *a);        //a->v is one of the mpc_* commands
+
 void toggle_update_checks(const Arg *a);
 void async_check_updates_handler(const Arg *a);
 void *check_updates(void *args);
+int check_updates_native(void);       //Cheap, no AUR. -1 if the pacman databases can't be read
 
 #endif
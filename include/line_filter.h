@@ -0,0 +1,33 @@
+#ifndef __LINE_FILTER_H_
+#define __LINE_FILTER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <regex.h>
+
+#define LINE_FILTER_MAX_PATTERNS  16      //Distinct patterns ever used
+#define LINE_FILTER_MAX_LINE      512     //Longer lines are cut before matching
+
+//In process replacements for "cmd | grep" and "cmd | wc -l". Output is fed as it is read, line by line.
+//Patterns are POSIX regular expressions (basic, like grep, unless REG_EXTENDED), compiled on first use
+//and kept. Thread safe.
+typedef struct LineFilter {
+  const regex_t *re;                      //NULL: only counts lines
+  char line[LINE_FILTER_MAX_LINE];
+  size_t len;
+  bool cut;
+  char *out;                              //Matching lines, newline terminated, as grep prints them
+  size_t size, used;
+  int lines;                              //Newlines seen, as wc -l
+  int matches;
+} LineFilter;
+
+const regex_t *line_filter_regex(const char *pattern, int cflags);    //NULL if it doesn't compile
+void line_filter_init(LineFilter *f, const char *pattern, int cflags, char *out, size_t size);
+void line_filter_feed(LineFilter *f, const char *data, size_t n);
+void line_filter_end(LineFilter *f);      //Last line, if it had no newline
+
+//Copies group (0: whole match, as grep -o) of the first match in text to buf. false if none
+bool line_filter_extract(const char *text, const char *pattern, int cflags, int group, char *buf, size_t size);
+
+#endif //_LINE_FILTER_H_
@@ -5,11 +5,16 @@
 
 enum {ShowMenuTopRight, ShowMenuFullscreen};
 
-//Menu functions
-int show_menu_rofi(int position, const char *prompt, const char *options[]);
+#define MENU_MAX_ENTRIES  8
+
+//Menu functions. selection is the index of the picked option, -1 if dismissed
+int show_menu_rofi(int position, const char *prompt, const char *options[]);   //Blocks until picked. Not from the main thread
+//Main thread. Returns right away, done() is called from the event loop once picked. -1 if rofi couldn't start
+typedef void (*ShowMenuDone)(int selection, void *data);
+int show_menu_rofi_async(int position, const char *prompt, const char *options[], ShowMenuDone done, void *data);
 
 //Menu scripts
-void menuscripts_powermenu(const Arg *a);
+void menuscripts_powermenu(const Arg *a);   //Main thread. Every menu is shown without blocking the WM
 
 typedef int (*ShowMenuFunction)(int position, const char *prompt, const char *options[]);
 // extern ShowMenuFunction menuFunction;  //Unused for now
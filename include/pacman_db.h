@@ -0,0 +1,18 @@
+#ifndef __PACMAN_DB_H_
+#define __PACMAN_DB_H_
+
+#define PACMAN_DB_ENV         "HORIZONWM_PACMAN_DB"    //Overrides db path, used to run against fixture databases
+#define PACMAN_CHECKUP_DB_ENV "CHECKUPDATES_DB"        //Private copy checkupdates refreshes, local/ links to the system one
+#define PACMAN_MAX_SYNC_DBS   32
+
+//The checkupdates db. The system sync dbs only change with pacman -Sy, they would miss new updates
+const char *pacman_db_path(void);
+
+//Number of installed packages with a newer version in the sync databases. -1 on error.
+//Scans local/ and sync/*.db (one thread per db) only when their mtimes changed since the last call.
+int pacman_db_count_updates(const char *dbpath);
+
+//alpm compatible version comparison. <0, 0 or >0
+int pacman_vercmp(const char *a, const char *b);
+
+#endif //_PACMAN_DB_H_
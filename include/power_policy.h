@@ -0,0 +1,33 @@
+#ifndef __POWER_POLICY_H_
+#define __POWER_POLICY_H_
+
+#include <stdbool.h>
+
+typedef enum PowerProfile {
+  POWER_PROFILE_PERFORMANCE,
+  POWER_PROFILE_BALANCED,
+  POWER_PROFILE_POWER_SAVER,
+  NumPowerProfiles
+} PowerProfile;
+
+//How often things are refreshed under each profile, in percent of their base interval
+typedef struct PowerPolicy {
+  const char *name;
+  unsigned int period_percent;    //Bar module periods
+  unsigned int sleep_percent;     //display_sleep() of the checker threads
+} PowerPolicy;
+
+//The profile follows the ACPI platform profile, which power-profiles-daemon drives, shifted one
+//step towards power saving on battery and one step towards performance on AC.
+//Without a platform profile it is balanced, so AC and battery alone still decide.
+#define POWER_PLATFORM_PROFILE  "firmware/acpi/platform_profile"   //Under sysfs_root()
+#define POWER_PROFILE_ENV       "HORIZONWM_POWER_PROFILE"           //Fixed profile name, ignores AC and platform profile
+
+void power_policy_init(void);           //Main thread. After power_supply_discover() and event_loop_init()
+void power_policy_check(void);          //Main thread. AC adapter or platform profile may have changed
+
+PowerProfile power_policy_profile(void);
+unsigned int power_policy_period(unsigned int period);     //Thread safe. Scaled module period, at least 1 s
+unsigned int power_policy_sleep(unsigned int seconds);     //Thread safe. Scaled checker sleep, at least 1 s
+
+#endif //_POWER_POLICY_H_
@@ -0,0 +1,47 @@
+#ifndef __POWER_SUPPLY_H_
+#define __POWER_SUPPLY_H_
+
+#include <stdbool.h>
+#include <sysfs.h>
+
+#define POWER_MAX_BATTERIES   4
+#define POWER_MAX_ADAPTERS    4
+#define POWER_MAX_BACKLIGHTS  4
+#define POWER_NAMELEN         64
+
+#define POWER_TTE_SMOOTHING   0.2     //Weight of the newest time-to-empty sample
+
+typedef struct Battery {
+  char name[POWER_NAMELEN];
+  bool energy;              //energy_* (uWh, uW) or charge_* (uAh, uA) attributes
+  SysfsAttr *now;
+  SysfsAttr *full;
+  SysfsAttr *rate;          //power_now or current_now
+  SysfsAttr *voltage;       //Used to convert charge to energy
+  SysfsAttr *capacity;      //Fallback when neither energy nor charge are exposed
+  SysfsAttr *status;
+} Battery;
+
+typedef struct Backlight {
+  char name[POWER_NAMELEN];
+  char folder[SYSFS_ATTR_PATHLEN];
+  SysfsAttr *brightness;
+  SysfsAttr *max_brightness;
+} Backlight;
+
+//Aggregated over all batteries and adapters
+typedef struct PowerStatus {
+  int nbatteries;
+  bool on_ac;
+  bool charging;
+  int percent;
+  float power_w;            //Total (dis)charge rate. 0 if unknown
+  int minutes_left;         //Smoothed time to empty while discharging. -1 if unknown
+} PowerStatus;
+
+void power_supply_discover(const char *root);   //Scans root/class/{power_supply,backlight}
+int  power_supply_read(PowerStatus *s);         //Returns -1 if there is no battery
+bool power_supply_on_ac(void);                  //Also true on machines without battery
+Backlight *backlight_get(void);                 //Preferred backlight or NULL. Controlled through backlight.h
+
+#endif //_POWER_SUPPLY_H_
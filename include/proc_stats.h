@@ -0,0 +1,59 @@
+#ifndef __PROC_STATS_H_
+#define __PROC_STATS_H_
+
+#include <stdbool.h>
+#include <time.h>
+
+#define PROC_STATS_MIN_INTERVAL   0.5     //Seconds. Samples closer than this reuse the previous rates
+#define PROC_MAX_IFACES           16
+#define PROC_MAX_DISKS            16      //Whole disks only
+#define PROC_MAX_SKIPPED_DISKS    64      //Partitions and virtual devices, remembered so they are only looked up once
+#define PROC_NAMELEN              32
+
+typedef struct CpuStats {
+  unsigned long long total, idle;
+  float usage;                  //Percent busy since previous sample
+} CpuStats;
+
+typedef struct MemStats {
+  unsigned long long total_kb, available_kb;
+  float usage;                  //Percent in use (total - available)
+} MemStats;
+
+typedef struct NetIface {
+  char name[PROC_NAMELEN];
+  unsigned long long rx_bytes, tx_bytes;
+  double rx_rate, tx_rate;      //Bytes per second
+  bool seen;                    //Present in the latest sample. If not, its slot is freed on the next one
+} NetIface;
+
+typedef struct NetStats {
+  NetIface ifaces[PROC_MAX_IFACES];
+  int nifaces;
+  double rx_rate, tx_rate;      //Sum of every interface but loopback
+} NetStats;
+
+typedef struct DiskDevice {
+  char name[PROC_NAMELEN];
+  unsigned long long read_sectors, write_sectors;
+  double read_rate, write_rate; //Bytes per second
+} DiskDevice;
+
+typedef struct DiskStats {
+  DiskDevice disks[PROC_MAX_DISKS];
+  int ndisks;
+  double read_rate, write_rate; //Sum of whole disks
+} DiskStats;
+
+//Each returns the latest sample, taking a new one if PROC_STATS_MIN_INTERVAL passed.
+//No heap allocation nor sscanf. Not thread safe, meant to be called from bar modules.
+CpuStats  *proc_stats_cpu(void);
+MemStats  *proc_stats_mem(void);
+NetStats  *proc_stats_net(void);
+DiskStats *proc_stats_disk(void);
+int proc_stats_temperature(void);     //Millidegrees Celsius from hwmon. -1 if there is no sensor
+//Marks the files of the samples that are due, so the next sysfs_attr_refresh() rereads them in its batch
+void proc_stats_expire(void);
+void proc_stats_block_changed(void);  //A block device was added or removed (uevent)
+
+#endif //_PROC_STATS_H_
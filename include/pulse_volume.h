@@ -0,0 +1,16 @@
+#ifndef __PULSE_VOLUME_H_
+#define __PULSE_VOLUME_H_
+
+#include <stdbool.h>
+
+//Native PulseAudio (or pipewire-pulse) backend for the default sink.
+//Keeps one connection open and caches the sink state, updated through change subscription.
+int  pulse_volume_init(void);                       //Returns -1 if built without PULSEAUDIO or it can't start
+bool pulse_volume_get(int *percent, bool *muted);   //Cached state. false if not connected (yet)
+
+//Asynchronous. The cached state is updated right away with the expected result.
+//Return -1 if not connected, so the caller can fall back to pamixer
+int  pulse_volume_change(int delta_percent);
+int  pulse_volume_toggle_mute(void);
+
+#endif //_PULSE_VOLUME_H_
@@ -2,11 +2,14 @@
 #define __SPAWN_PROGRAMS_H_
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
 #include <horizonwm_type_definitions.h>
 
 //PROGRAM FLAGS
 #define PROGRAM_RUN_STARTUP     0b0000000000000001
 #define PROGRAM_RERUN_RESTART   0b0000000000000010
+#define PROGRAM_STATUS_FEEDER   0b0000000000000100    //Its stdout feeds the bar. See status_feed.h
 
 typedef struct ProgramService {
   const char **cmd;
@@ -15,20 +18,43 @@ typedef struct ProgramService {
 } ProgramService;
 
 
+//Every program is started by spawn_launch(), on posix_spawn: the WM is never forked, and the child gets
+//stdin, stdout and stderr only. in, out and err are dup'ed onto them, or one of:
+#define SPAWN_INHERIT   -1    //Same as the WM
+#define SPAWN_DEVNULL   -2    ///dev/null
+//spawn_launch() asks the launcher process (zygote.h) to start it, and only starts it itself if that is down
+pid_t spawn_launch(const char *const argv[], int in, int out, int err);       //Returns -1 if it couldn't start
+int   spawn_launch_wait(const char *const argv[], int in, int out, int err);  //Waits. Returns its wait status, or -1
+pid_t spawn_launch_local(const char *const argv[], int in, int out, int err); //In this process. -1 and errno if it couldn't
+
 //All these functions spawn a program, each doing different functionality
 void spawn(const Arg *arg);                                           //Spawns a program
 unsigned int spawn_pid(const Arg *arg);                               //Spawns a program, returns its pid
 void spawn_waitpid(const Arg *arg);                                   //Spawns a program. Waits until program terminates
 void spawn_catchoutput(const Arg *, char *, size_t);                  //Spawns a program. Saves program output in buffer with size
 void spawn_devnull(const Arg *arg);                                   //Spawns a program. Feeds output to /dev/null
-void spawn_greppattern(const Arg *, const char *flags, const char *p, char *b, size_t);  //Spawns a program. Passes output by grep
+int spawn_greppattern(const Arg *, const char *pattern, char *b, size_t);      //Spawns a program. Saves lines matching pattern (line_filter.h) in buffer. Returns how many
 int spawn_countlines(const Arg *);                                    //Spawns a program. Returns number of lines in output
 int spawn_readint(const Arg *);                                       //Spawns a program. Expects int as output of program. Returns it.
 int spawn_readint_feedstdin(const Arg *, const char *buf);            //Spawns a program. Feeds it string to stdin. Expects int as output of program. Returns it.
 int spawn_retval(const Arg *);                                        //Spawns a program. Returns the exit value of the program.
+int spawn_capture(const char *const argv[], char *buf, size_t size);   //Spawns a program. Saves all its output that fits in buf. Returns its wait status, or -1
+unsigned int spawn_pipe(const Arg *, int *fd);                        //Spawns a program. Sets fd to the read end of its stdout. Returns its pid
 
 void spawn_programs_list(ProgramService *l);
 
+//ASYNCHRONOUS. Main thread only
+//The program runs while the WM goes on. Its stdout is gathered by the event loop, and done() is called
+//from there once it has exited and closed it. Nothing ever waits for the program.
+#define SPAWN_ASYNC_MAX_JOBS    8
+#define SPAWN_ASYNC_MAX_OUTPUT  1024  //Output past this is discarded
+typedef struct SpawnJob SpawnJob;
+typedef void (*SpawnDone)(int status, const char *output, void *data);  //Wait status, or -1 if unknown
+//input (may be NULL) is fed to its stdin. With capture, output holds its stdout, else it is inherited.
+//Returns NULL if it couldn't start, done() won't be called then. The handle is invalid once done() returns,
+//which may be before spawn_async() does, when the event loop can't follow the program
+SpawnJob *spawn_async(const char *const argv[], const char *input, bool capture, SpawnDone done, void *data);
+
 /* commands */
 extern const char *browsercmd[];
 extern const char *browser_private_cmd[];
@@ -43,6 +69,7 @@ extern const char *calculatorcmd[];
 extern const char *dunstcmd[];
 extern const char *configkeyboardcmd[];
 extern const char *wallpapercmd[];
+extern const char *statusfeedercmd[];
 
 //Monitor brightness
 extern const char *downbrightnesscmd[];
@@ -53,6 +80,8 @@ extern const char *monitoroffcmd[];
 extern const char *upvolumecmd[];
 extern const char *downvolume[];
 extern const char *mutevolume[];
+extern const char *getvolumecmd[];
+extern const char *getmutecmd[];
 
 //Keyboard brightness
 extern const char *KBdownbrightnesscmd[];
@@ -76,6 +105,7 @@ extern const char *mpc_stop[];
 extern const char *mpc_next[];
 extern const char *mpc_volumeup[];
 extern const char *mpc_volumedown[];
+extern const char *mpc_status[];
 
 // List of programs to be run at startup
 extern ProgramService startup_programs[];
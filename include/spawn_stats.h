@@ -0,0 +1,33 @@
+#ifndef __SPAWN_STATS_H_
+#define __SPAWN_STATS_H_
+
+#include <stdio.h>
+#include <children.h>
+
+//What the programs we spawn cost, per tag (the bar module or action that spawned them) and program.
+//Each thread has a current tag, every program it spawns is accounted to it. spawn_async() callbacks run
+//with the tag of the job, so whatever they spawn next is accounted to the same one.
+//kill -USR1 <horizonwm> writes the statistics to SPAWN_STATS_FILE in $XDG_RUNTIME_DIR, or to stderr without one
+#define SPAWN_STATS_MAX_ENTRIES   64      //(tag, program) pairs. Later ones are accounted to SPAWN_STATS_OTHER
+#define SPAWN_STATS_PROGRAM_LEN   24
+#define SPAWN_STATS_OTHER         "other"
+#define SPAWN_STATS_FILE          "horizonwm-stats"
+
+typedef struct SpawnStatsRun {
+  const char *tag;
+  char program[SPAWN_STATS_PROGRAM_LEN];
+  long long start_us;
+} SpawnStatsRun;
+
+void spawn_stats_init(void);                              //Main thread, before any other thread exists
+
+//Tags are kept, not copied: string literals only
+const char *spawn_stats_tag(void);                        //Of this thread
+const char *spawn_stats_set_tag(const char *tag);         //Of this thread. Returns the previous one
+
+void spawn_stats_start(SpawnStatsRun *run, const char *program);     //Right before spawning it
+void spawn_stats_end(const SpawnStatsRun *run, const ChildUsage *usage);  //Reaped. usage NULL: not waited for, only counted
+
+void spawn_stats_dump(FILE *f);                           //Most expensive first
+
+#endif //_SPAWN_STATS_H_
@@ -0,0 +1,40 @@
+#ifndef __STATUS_FEED_H_
+#define __STATUS_FEED_H_
+
+#include <stdbool.h>
+
+#define STATUS_FEED_MAX_FEEDERS   8
+#define STATUS_FEED_MAX_SEGMENTS  8
+#define STATUS_FEED_NAMELEN       32
+#define STATUS_FEED_TEXTLEN       128
+#define STATUS_FEED_LINELEN       4096
+
+//Long lived programs from startup_programs[] with PROGRAM_STATUS_FEEDER stream their status over stdout.
+//Every line is one block, which replaces the previous block of that feeder:
+//  - Plain text: a single segment with that text.
+//  - JSON (i3bar style): an array of {"name", "full_text", "color"} objects. A leading "[" line
+//    and "," before each array are accepted, so i3status-like generators work as they are.
+typedef struct StatusSegment {
+  char name[STATUS_FEED_NAMELEN];
+  char text[STATUS_FEED_TEXTLEN];
+  char color[8];                      //"#rrggbb" or empty
+} StatusSegment;
+
+typedef struct StatusFeeder {
+  int fd;
+  int pid;
+  StatusSegment segments[STATUS_FEED_MAX_SEGMENTS];
+  int nsegments;
+  char line[STATUS_FEED_LINELEN];     //Partial line not yet terminated by '\n'
+  int linelen;
+  bool discarding;                    //Current line overflowed, skip until its end
+} StatusFeeder;
+
+//Main thread only. Registers the read end of the feeder stdout pipe in the event loop
+int status_feed_add(int fd, int pid);
+void status_feed_handler(int fd, short revents, void *data);
+
+//Joins the segments of every feeder. Returns the color of the first segment that has one, or NULL
+const char *status_feed_text(char *buffer, int size);
+
+#endif //_STATUS_FEED_H_
@@ -0,0 +1,45 @@
+#ifndef __SYSFS_H_
+#define __SYSFS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#define SYSFS_MAX_ATTRS       64
+#define SYSFS_ATTR_PATHLEN    256
+#define SYSFS_ATTR_VALUELEN   64
+#define SYSFS_ATTR_MAXAGE     30      //Seconds. Reread even without uevent, some firmwares don't emit them
+
+//A sysfs attribute kept open. Its value is cached until a uevent for its subsystem arrives.
+//Bigger files (/proc) are kept the same way, read into a buffer of their own
+typedef struct SysfsAttr {
+  char path[SYSFS_ATTR_PATHLEN];
+  int fd;
+  bool valid;
+  struct timespec read_time;
+  char value[SYSFS_ATTR_VALUELEN];
+  char *buf;                      //value, or the buffer given to sysfs_attr_get_buffer()
+  int size;
+} SysfsAttr;
+
+#define SYSFS_DEFAULT_ROOT    "/sys"
+#define SYSFS_ROOT_ENV        "HORIZONWM_SYSFS_ROOT"   //Overrides root, used to run against a fake sysfs tree
+
+const char *sysfs_root(void);
+
+SysfsAttr *sysfs_attr_get(const char *path);    //Opens attribute once. Returns NULL if it can't be opened
+//Same, read into buf instead. buf belongs to the thread calling sysfs_attr_refresh(), only it may look at it
+SysfsAttr *sysfs_attr_get_buffer(const char *path, char *buf, int size);
+//Copies the cached value into buf, rereading it with pread() when invalid. -1 on error.
+//The cache is shared between threads, so it is never handed out directly. A NULL buf only rereads it
+int sysfs_attr_read(SysfsAttr *a, char *buf, size_t size);
+int sysfs_attr_int(SysfsAttr *a);
+float sysfs_attr_float(SysfsAttr *a);
+void sysfs_attr_invalidate(const char *prefix); //Invalidates all attributes whose path starts with prefix
+void sysfs_attr_refresh(void);                  //Rereads every invalid attribute in one batch
+
+//Kernel uevents (NETLINK_KOBJECT_UEVENT)
+int sysfs_uevent_open(void);
+void sysfs_uevent_handler(int fd, short revents, void *data);
+
+#endif //_SYSFS_H_
@@ -0,0 +1,21 @@
+#ifndef __ZYGOTE_H_
+#define __ZYGOTE_H_
+
+#include <sys/types.h>
+#include <children.h>
+
+//Small helper process forked once at startup, while the WM is still small and single threaded.
+//It starts every program afterwards, so the WM never forks again and none of its children are
+//the WM's: the helper reaps them and reports their exit status back.
+//Requests go over a SOCK_SEQPACKET socketpair: argv, how to set up stdin/stdout/stderr, and the
+//descriptors themselves (SCM_RIGHTS). Each request brings a pipe on which the helper answers with
+//the pid and, if asked, later with the exit status and resource usage. So threads never share a reply channel.
+#define ZYGOTE_ARGV_MAX       4096    //Bytes of NUL separated arguments
+#define ZYGOTE_MAX_WAITING    256     //Programs whose exit status someone waits for at once
+#define ZYGOTE_DOWN           -2      //zygote_spawn(): helper not running, start it some other way
+
+int   zygote_start(void);             //Main thread, before any other thread exists. -1 if it couldn't
+pid_t zygote_spawn(const char *const argv[], int in, int out, int err, int *status_fd);   //Thread safe
+int   zygote_wait(int status_fd, ChildUsage *usage);  //Blocks until it exits. Wait status, or -1. Closes status_fd
+
+#endif //_ZYGOTE_H_
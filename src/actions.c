@@ -0,0 +1,65 @@
+#include <actions.h>
+#include <spawn_programs.h>
+#include <event_loop.h>
+#include <bar_modules.h>
+
+#include <stdio.h>
+#include <stdbool.h>
+
+typedef struct RunningAction {
+  bool used;
+  const ActionStep *next;                 //Step after the program that runs
+} RunningAction;
+
+static RunningAction running[ACTION_MAX_RUNNING];
+
+static void action_continue(const ActionStep *step);
+
+static void action_spawned_exited(int status, const char *output, void *data){
+  RunningAction *r = (RunningAction *) data;
+  const ActionStep *next = r->next;
+
+  r->used = false;
+  action_continue(next);
+}
+
+static RunningAction *action_slot(void){
+  for (int i = 0; i < ACTION_MAX_RUNNING; i++){
+    if (!running[i].used){
+      return &running[i];
+    }
+  }
+  return NULL;
+}
+
+//Runs steps until one has to wait for a program
+static void action_continue(const ActionStep *step){
+  RunningAction *r;
+
+  for (; step->type != ActionEnd; step++){
+    switch (step->type){
+      case ActionSpawn:
+        if ((r = action_slot()) == NULL){
+          fprintf(stderr, "horizonwm: too many actions running, '%s' dropped\n", ((const char **) step->arg.v)[0]);
+          return;
+        }
+        r->used = true;
+        r->next = step + 1;
+        //The rest of the chain depends on it: if it didn't start, it stops here
+        if (spawn_async(step->arg.v, NULL, false, action_spawned_exited, r) == NULL){
+          r->used = false;
+        }
+        return;
+      case ActionCall:
+        step->func(&step->arg);
+        break;
+      case ActionRefresh:
+        request_drawbars_modules(step->arg.ui ? bar_modules_mask(step->arg.ui) : ~0u);
+        break;
+    }
+  }
+}
+
+void run_action(const Arg *a){
+  action_continue((const ActionStep *) a->v);
+}
@@ -0,0 +1,206 @@
+#include <backlight.h>
+#include <power_supply.h>
+#include <spawn_programs.h>
+#include <event_loop.h>
+#include <sysfs.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+static Backlight *bl = NULL;
+static int write_fd = -1;               //brightness, O_WRONLY. -1 means logind
+static int fade_fd = -1;
+
+//Fade in progress
+static int fade_from, fade_to;
+static int fade_tick, fade_ticks;
+
+//Brightness shown instead of the real one while a change is on its way. Main thread only
+static int expected_percent = -1;
+static int expected_raw;                //Real brightness that keeps it valid
+static bool expected_until_reached;     //Ours: valid until the real brightness reaches expected_raw
+static struct timespec expected_time;
+
+static int max_raw(void){
+  return bl ? sysfs_attr_int(bl->max_brightness) : 0;
+}
+
+static int percent_to_raw(int percent, int max){
+  int raw = (int) lround(max * pow(percent / 100.0, BACKLIGHT_EXPONENT));
+  return raw == 0 && percent > 0 ? 1 : raw;
+}
+
+static int raw_to_percent(int raw, int max){
+  return (int) lround(100 * pow((double) raw / max, 1 / BACKLIGHT_EXPONENT));
+}
+
+static void set_expected(int percent, int raw, bool until_reached){
+  expected_percent = percent;
+  expected_raw = raw;
+  expected_until_reached = until_reached;
+  clock_gettime(CLOCK_MONOTONIC, &expected_time);
+}
+
+//Sets the brightness attribute right now
+static void backlight_write(int raw){
+  char value[16];
+  int len = snprintf(value, sizeof(value), "%d", raw);
+
+  //sysfs attributes are written whole, from offset 0
+  if (write_fd >= 0){
+    pwrite(write_fd, value, len, 0);
+    return;
+  }
+
+  //Through logind, which owns the device for the active session
+  const char *cmd[] = {"busctl", "call", "--system", "org.freedesktop.login1", "/org/freedesktop/login1/session/auto",
+                       "org.freedesktop.login1.Session", "SetBrightness", "ssu", "backlight", bl->name, value, NULL};
+  Arg arg = {.v = cmd};
+  spawn(&arg);
+}
+
+static void fade_arm(bool on){
+  struct itimerspec its;
+
+  memset(&its, 0, sizeof(its));
+  if (on){
+    its.it_value.tv_nsec = BACKLIGHT_FADE_TICK_MS * 1000000L;
+    its.it_interval = its.it_value;
+  }
+  timerfd_settime(fade_fd, 0, &its, NULL);
+}
+
+static void fade_handler(int fd, short revents, void *data){
+  unsigned long long expirations;
+
+  if (read(fd, &expirations, sizeof(expirations)) < 0 || fade_ticks == 0){
+    return;
+  }
+
+  //Late ticks are skipped, the fade never takes longer than it should
+  fade_tick += expirations;
+  if (fade_tick >= fade_ticks){
+    fade_tick = fade_ticks;
+    fade_arm(false);
+  }
+  backlight_write(fade_from + (fade_to - fade_from) * fade_tick / fade_ticks);
+}
+
+int backlight_set_percent(int percent){
+  int max, raw, current;
+
+  if (bl == NULL || (max = max_raw()) <= 0){
+    return -1;
+  }
+  if (percent < BACKLIGHT_MIN_PERCENT) percent = BACKLIGHT_MIN_PERCENT;
+  if (percent > 100) percent = 100;
+
+  //From where the light is now: a running fade, what we wrote last, or the attribute
+  if (fade_tick < fade_ticks){
+    current = fade_from + (fade_to - fade_from) * fade_tick / fade_ticks;
+  } else if (expected_percent >= 0 && expected_until_reached){
+    current = expected_raw;
+  } else {
+    current = sysfs_attr_int(bl->brightness);
+  }
+
+  raw = percent_to_raw(percent, max);
+  set_expected(percent, raw, true);
+
+  //Fading through logind would take one process per tick
+  fade_ticks = BACKLIGHT_FADE_MS / BACKLIGHT_FADE_TICK_MS;
+  if (fade_fd < 0 || write_fd < 0 || fade_ticks <= 1 || current == raw){
+    if (fade_fd >= 0){
+      fade_arm(false);
+    }
+    fade_tick = fade_ticks = 0;
+    backlight_write(raw);
+    return 0;
+  }
+
+  fade_from = current;
+  fade_to = raw;
+  fade_tick = 1;
+  backlight_write(fade_from + (fade_to - fade_from) / fade_ticks);
+  fade_arm(true);
+  return 0;
+}
+
+int backlight_step(int delta){
+  int percent = backlight_percent();
+
+  if (percent < 0){
+    return -1;
+  }
+  return backlight_set_percent(percent + delta);
+}
+
+int backlight_percent(void){
+  struct timespec now;
+  bool recent, valid;
+  int max, raw;
+
+  if (bl == NULL || (max = max_raw()) <= 0){
+    return -1;
+  }
+  raw = sysfs_attr_int(bl->brightness);
+
+  if (expected_percent >= 0){
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    recent = now.tv_sec - expected_time.tv_sec <= BACKLIGHT_EXPECT_TIMEOUT;
+    if (expected_until_reached){
+      //Ours. Kept while fading and once reached, so rounding doesn't make it jump. The attribute may
+      //still hold the old value for a moment, until its uevent arrives
+      valid = fade_tick < fade_ticks || raw == expected_raw || recent;
+    } else {
+      //Changed by another program. Kept until the attribute moves away from where it was
+      valid = raw == expected_raw && recent;
+    }
+    if (valid){
+      return expected_percent;
+    }
+    expected_percent = -1;
+  }
+
+  return raw_to_percent(raw, max);
+}
+
+void backlight_expect(int percent){
+  if (bl == NULL){
+    return;
+  }
+  set_expected(percent < 0 ? 0 : percent > 100 ? 100 : percent, sysfs_attr_int(bl->brightness), false);
+}
+
+void backlight_invalidate(void){
+  char prefix[SYSFS_ATTR_PATHLEN];
+
+  if (bl == NULL){
+    return;
+  }
+  snprintf(prefix, sizeof(prefix), "%.*s/", SYSFS_ATTR_PATHLEN - 2, bl->folder);
+  sysfs_attr_invalidate(prefix);
+}
+
+int backlight_control_init(void){
+  char path[SYSFS_ATTR_PATHLEN];
+
+  if ((bl = backlight_get()) == NULL){
+    return -1;
+  }
+
+  snprintf(path, sizeof(path), "%.*s/brightness", SYSFS_ATTR_PATHLEN - 12, bl->folder);
+  write_fd = open(path, O_WRONLY | O_CLOEXEC);
+
+  if ((fade_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) >= 0
+  && event_loop_watch(fade_fd, POLLIN, fade_handler, NULL) < 0){
+    close(fade_fd);
+    fade_fd = -1;
+  }
+  return 0;
+}
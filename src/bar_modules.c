@@ -7,10 +7,14 @@
 #include <spawn_programs.h>
 #include <stdbool.h>
 #include <global_vars.h>
-
-#define BATTERY_STATUS_FOLDER "/sys/class/power_supply/BAT"
-#define AC_ADAPTER_FOLDER     "/sys/class/power_supply/AC"
-#define BRIGHTNESS_FOLDER     "/sys/class/backlight/amdgpu_bl1"
+#include <power_supply.h>
+#include <backlight.h>
+#include <pulse_volume.h>
+#include <proc_stats.h>
+#include <status_feed.h>
+#include <command_cache.h>
+#include <actions.h>
+#include <event_loop.h>
 
 #define BATTERY_HEALTHY 0
 #define BATTERY_LOW 1
@@ -28,19 +32,29 @@ int old_updates = 0;
 extern BarModule bar_modules[];
 BarModule bar_modules[] = {
     //module function               onClick function              module ID (can be 0)    period of module (s)   pixel width on bar
-    {date_barmodule,                NULL,                         BAR_MODULE_DATE,              0,                0},
+    //Modules with period 0 are only refreshed when something changes (uevents, PulseAudio, checker threads...)
+    {date_barmodule,                NULL,                         BAR_MODULE_DATE,              BAR_DATE_PERIOD,  0},
     {keyboard_mapping_barmodule,    keyboard_mapping_clicked,     BAR_MODULE_KEYBOARDMAPPING,   0,                0},
-    {battery_status_barmodule,      NULL,                         BAR_MODULE_BATTERYSTATUS,     0,                0},
+    {battery_status_barmodule,      NULL,                         BAR_MODULE_BATTERYSTATUS,     30,               0},
     {wired_connection_barmodule,    NULL,                         BAR_MODULE_WIRED,             0,                0},
     {wireless_barmodule,            NULL,                         BAR_MODULE_WIRELESS,          0,                0},
     {brightness_barmodule,          brightness_clicked,           BAR_MODULE_BRIGHTNESS,        0,                0},
     {volume_barmodule,              volume_clicked,               BAR_MODULE_VOLUME,            0,                0},
 
-    {openvpn_barmodule,             NULL,                         BAR_MODULE_OPENVPN,           0,                0},
+    {openvpn_barmodule,             NULL,                         BAR_MODULE_OPENVPN,           10,               0},
 
     {wm_mode_barmodule,             NULL,                         BAR_MODULE_WMMODE,            0,                0},
 
-    {updates_barmodule,             updates_clicked,              BAR_MODULE_UPDATES,           1,                0},
+    {status_feed_barmodule,         NULL,                         BAR_MODULE_STATUSFEED,        0,                0},
+
+    //System monitor
+    {temperature_barmodule,         NULL,                         BAR_MODULE_TEMPERATURE,       BAR_SYSMON_PERIOD, 0},
+    {disk_barmodule,                NULL,                         BAR_MODULE_DISK,              BAR_SYSMON_PERIOD, 0},
+    {network_barmodule,             NULL,                         BAR_MODULE_NETWORK,           BAR_SYSMON_PERIOD, 0},
+    {memory_barmodule,              NULL,                         BAR_MODULE_MEMORY,            BAR_SYSMON_PERIOD, 0},
+    {cpu_barmodule,                 NULL,                         BAR_MODULE_CPU,               BAR_SYSMON_PERIOD, 0},
+
+    {updates_barmodule,             updates_clicked,              BAR_MODULE_UPDATES,           0,                0},
 
     //MPD
     {mpd_next_barmodule,            mpd_next_clicked,             BAR_MODULE_MPC,               0,                0},
@@ -52,6 +66,49 @@ BarModule bar_modules[] = {
     {NULL, NULL, 0, 0, 0}
 };
 
+/* compile-time check if all modules fit in bar_modules_output */
+struct NumBarModules { char limitexceeded[sizeof bar_modules / sizeof bar_modules[0] - 1 > BAR_MAX_MODULES ? -1 : 1]; };
+
+BarModuleOutput bar_modules_output[BAR_MAX_MODULES];
+unsigned long bar_module_repaints = 0;
+unsigned long bar_module_repaints_skipped = 0;
+
+unsigned int bar_modules_mask(unsigned int id){
+  unsigned int mask = 0;
+
+  for (int i = 0; bar_modules[i].function != NULL; i++){
+    if (bar_modules[i].id == id){
+      mask |= 1u << i;
+    }
+  }
+  return mask;
+}
+
+const char *bar_module_name(unsigned int id){
+  static const char *names[] = {
+    [BAR_DEFAULT_MODULE]          = "default",
+    [BAR_MODULE_DATE]             = "date",
+    [BAR_MODULE_KEYBOARDMAPPING]  = "keyboard",
+    [BAR_MODULE_BATTERYSTATUS]    = "battery",
+    [BAR_MODULE_BRIGHTNESS]       = "brightness",
+    [BAR_MODULE_VOLUME]           = "volume",
+    [BAR_MODULE_UPDATES]          = "updates",
+    [BAR_MODULE_OPENVPN]          = "openvpn",
+    [BAR_MODULE_WMMODE]           = "wm mode",
+    [BAR_MODULE_WIRELESS]         = "wireless",
+    [BAR_MODULE_WIRED]            = "wired",
+    [BAR_MODULE_MPC]              = "mpd",
+    [BAR_MODULE_CPU]              = "cpu",
+    [BAR_MODULE_MEMORY]           = "memory",
+    [BAR_MODULE_NETWORK]          = "network",
+    [BAR_MODULE_DISK]             = "disk",
+    [BAR_MODULE_TEMPERATURE]      = "temperature",
+    [BAR_MODULE_STATUSFEED]       = "status feed",
+  };
+
+  return id < sizeof(names) / sizeof(names[0]) && names[id] != NULL ? names[id] : "bar";
+}
+
 int wired_connection_barmodule(BAR_MODULE_ARGUMENTS){
   bool is_con;
 
@@ -87,6 +144,80 @@ int wireless_barmodule(BAR_MODULE_ARGUMENTS){
   return 0;
 }
 
+//Bytes per second as "12K", "3.4M"...
+static void format_rate(char *buffer, int size, double rate){
+  const char units[] = "BKMGT";
+  int u = 0;
+
+  while (rate >= 1000 && units[u+1] != '\0'){
+    rate /= 1024;
+    u++;
+  }
+  if (rate < 10 && u > 0){
+    snprintf(buffer, size, "%.1f%c", rate, units[u]);
+  } else {
+    snprintf(buffer, size, "%.0f%c", rate, units[u]);
+  }
+}
+
+int cpu_barmodule(BAR_MODULE_ARGUMENTS){
+  CpuStats *cpu = proc_stats_cpu();
+
+  if (cpu->usage >= 90){
+    strcpy(color, COLOR_WARNING);
+  }
+  snprintf(retstring, bufsize, " %3.0f%%", cpu->usage);
+  return 0;
+}
+
+int memory_barmodule(BAR_MODULE_ARGUMENTS){
+  MemStats *mem = proc_stats_mem();
+
+  if (mem->total_kb == 0){
+    return -1;
+  }
+  if (mem->usage >= 90){
+    strcpy(color, COLOR_WARNING);
+  }
+  snprintf(retstring, bufsize, " %.1fG", (mem->total_kb - mem->available_kb) / 1048576.0);
+  return 0;
+}
+
+int network_barmodule(BAR_MODULE_ARGUMENTS){
+  NetStats *net = proc_stats_net();
+  char rx[16], tx[16];
+
+  format_rate(rx, sizeof(rx), net->rx_rate);
+  format_rate(tx, sizeof(tx), net->tx_rate);
+  snprintf(retstring, bufsize, " %5s  %5s", rx, tx);
+  return 0;
+}
+
+int disk_barmodule(BAR_MODULE_ARGUMENTS){
+  DiskStats *disk = proc_stats_disk();
+  char rd[16], wr[16];
+
+  format_rate(rd, sizeof(rd), disk->read_rate);
+  format_rate(wr, sizeof(wr), disk->write_rate);
+  snprintf(retstring, bufsize, " R %5s W %5s", rd, wr);
+  return 0;
+}
+
+int temperature_barmodule(BAR_MODULE_ARGUMENTS){
+  int temp = proc_stats_temperature();
+
+  if (temp < 0){
+    return -1;
+  }
+  if (temp >= 90000){
+    strcpy(color, COLOR_DISABLED);
+  } else if (temp >= 80000){
+    strcpy(color, COLOR_WARNING);
+  }
+  snprintf(retstring, bufsize, " %d°C", temp / 1000);
+  return 0;
+}
+
 int mpd_prev_barmodule(BAR_MODULE_ARGUMENTS){
   int localstatus;
 
@@ -185,6 +316,19 @@ int mpd_status_barmodule(BAR_MODULE_ARGUMENTS){
   return 0;
 }
 
+//Blocks streamed by PROGRAM_STATUS_FEEDER programs
+int status_feed_barmodule(BAR_MODULE_ARGUMENTS){
+  const char *feed_color = status_feed_text(retstring, bufsize);
+
+  if (retstring[0] == '\0'){
+    return -1;
+  }
+  if (feed_color){
+    strcpy(color, feed_color);
+  }
+  return 0;
+}
+
 int wm_mode_barmodule(BAR_MODULE_ARGUMENTS){
   if (wm_mode == WMModeDraw){
     strcpy(retstring, "");
@@ -192,14 +336,29 @@ int wm_mode_barmodule(BAR_MODULE_ARGUMENTS){
   return 0;
 }
 
-int openvpn_barmodule(BAR_MODULE_ARGUMENTS){
-  Arg a;
-  char ovpn_status[32];
+static bool ovpn_active = false;
+static bool ovpn_checking = false;
 
-  a.v = sysctl_status_ovpn;
-  spawn_catchoutput(&a, ovpn_status, 31);
+static void openvpn_checked(int status, const char *output, void *data){
+  bool active = strncmp(output, "active", 6) == 0;
 
-  if (strncmp(ovpn_status, "active", 6) == 0){
+  ovpn_checking = false;
+  if (active != ovpn_active){
+    ovpn_active = active;
+    request_drawbars_modules(bar_modules_mask(BAR_MODULE_OPENVPN));
+  }
+}
+
+int openvpn_barmodule(BAR_MODULE_ARGUMENTS){
+  //systemctl answers later, meanwhile the last answer is shown. Redraws in between reuse it
+  if (!ovpn_checking){
+    ovpn_checking = true;
+    if (command_cache_async(sysctl_status_ovpn, OPENVPN_STATUS_TTL_MS, openvpn_checked, NULL) < 0){
+      ovpn_checking = false;
+    }
+  }
+
+  if (ovpn_active){
     snprintf(retstring, bufsize, " VPN");
     strcpy(color, COLOR_ENABLED);
   }
@@ -243,15 +402,22 @@ int updates_barmodule(BAR_MODULE_ARGUMENTS){
   old_updates = n_updates_pacman_local + n_updates_aur_local;
   return 0;
 }
-int updates_clicked(int mask, int button){
+//Once the terminal upgrading the system is closed, count again
+static const ActionStep update_system_action[] = {
+  ACTION_SPAWN(updatearchlinuxcmd),
+  ACTION_CALL(async_check_updates_handler, {0}),
+  ACTION_END
+};
+
+int updates_clicked(int mask, int button, int clicks){
   Arg a;
   switch(button){
     case 1:
       async_check_updates_handler(NULL);
       return 0;
     case 2:
-      a.v = updatearchlinuxcmd;
-      spawn(&a);
+      a.v = update_system_action;
+      run_action(&a);
       return 0;
     case 3:
       toggle_update_checks(NULL);
@@ -261,7 +427,7 @@ int updates_clicked(int mask, int button){
   }
 }
 
-int mpd_status_clicked(int mask, int button){
+int mpd_status_clicked(int mask, int button, int clicks){
   Arg a;
   switch(button){
     case 1:
@@ -271,92 +437,135 @@ int mpd_status_clicked(int mask, int button){
       return -1;
   }
 }
-int mpd_prev_clicked(int mask, int button){
+int mpd_prev_clicked(int mask, int button, int clicks){
   Arg a;
   switch(button){
     case 1:
       a.v = mpc_prev;
-      spawn_waitpid(&a);
-      setmpcstatus(NULL);
+      mpd_action(&a);
       return 0;
     default:
       return -1;
   }
 }
-int mpd_playpause_clicked(int mask, int button){
+int mpd_playpause_clicked(int mask, int button, int clicks){
   Arg a;
   switch(button){
     case 1:
       a.v = mpc_toggle;
-      spawn_waitpid(&a);
-      setmpcstatus(NULL);
+      mpd_action(&a);
       return 0;
     default:
       return -1;
   }
 }
-int mpd_stop_clicked(int mask, int button){
+int mpd_stop_clicked(int mask, int button, int clicks){
   Arg a;
   switch(button){
     case 1:
       a.v = mpc_stop;
-      spawn_waitpid(&a);
-      setmpcstatus(NULL);
+      mpd_action(&a);
       return 0;
     default:
       return -1;
   }
 }
-int mpd_next_clicked(int mask, int button){
+int mpd_next_clicked(int mask, int button, int clicks){
   Arg a;
   switch(button){
     case 1:
       a.v = mpc_next;
-      spawn_waitpid(&a);
-      setmpcstatus(NULL);
+      mpd_action(&a);
       return 0;
     default:
       return -1;
   }
 }
 
-int volume_clicked(int mask, int button){
+int volume_clicked(int mask, int button, int clicks){
   Arg a;
   switch(button){
     case 1:
-      a.v = mutevolume;
-      spawn_waitpid(&a);
+      toggle_mute(NULL);
       return 0;
     case 4:
-      a.v = upvolumecmd;
-      spawn_waitpid(&a);
+      a.i = +5 * clicks;
+      change_volume(&a);
       return 0;
     case 5:
-      a.v = downvolume;
-      spawn_waitpid(&a);
+      a.i = -5 * clicks;
+      change_volume(&a);
       return 0;
     default:
       return -1;
       break;
   }
 }
-int volume_barmodule(BAR_MODULE_ARGUMENTS){
-  char buffer_pamixeroutput[8];
-  char *icon = "";
+//Without PulseAudio connection, volume as last read by pamixer
+static int pamixer_percent = 0;
+static bool pamixer_muted = false;
+static bool pamixer_reading = false;
+static bool pamixer_expected = false;
+
+void volume_expect(int delta){
+  pamixer_percent += delta;
+  pamixer_percent = pamixer_percent < 0 ? 0 : pamixer_percent > 100 ? 100 : pamixer_percent;
+  pamixer_expected = true;
+  request_drawbars_modules(bar_modules_mask(BAR_MODULE_VOLUME));
+}
+void volume_expect_mute(void){
+  pamixer_muted = !pamixer_muted;
+  pamixer_expected = true;
+  request_drawbars_modules(bar_modules_mask(BAR_MODULE_VOLUME));
+}
+void volume_expect_clear(void){
+  pamixer_expected = false;
+}
+
+static void pamixer_mute_read(int status, const char *output, void *data){
+  int percent = (int)(long) data;
+  bool muted = output[0] == 't';
 
-  const char *getvolume_cmd[] = {"pamixer", "--get-volume", NULL };
-  Arg getvolume_arg = {.v = getvolume_cmd};
+  pamixer_reading = false;
+  //Started before the change was applied, it would show the old volume
+  if (pamixer_expected){
+    return;
+  }
+  if (percent != pamixer_percent || muted != pamixer_muted){
+    pamixer_percent = percent;
+    pamixer_muted = muted;
+    request_drawbars_modules(bar_modules_mask(BAR_MODULE_VOLUME));
+  }
+}
+
+static void pamixer_volume_read(int status, const char *output, void *data){
+  if (command_cache_async(getmutecmd, PAMIXER_TTL_MS, pamixer_mute_read, (void *)(long) atoi(output)) < 0){
+    pamixer_reading = false;
+  }
+}
 
-  const char *getmute_cmd[] = {"pamixer", "--get-mute", NULL };
-  Arg getmute_arg = {.v = getmute_cmd};
+int volume_barmodule(BAR_MODULE_ARGUMENTS){
+  char *icon = "";
+  int percent;
+  bool muted;
+
+  //Cached default sink state, kept up to date by the PulseAudio subscription
+  if (!pulse_volume_get(&percent, &muted)){
+    if (!pamixer_reading && !pamixer_expected){
+      pamixer_reading = true;
+      if (command_cache_async(getvolumecmd, PAMIXER_TTL_MS, pamixer_volume_read, NULL) < 0){
+        pamixer_reading = false;
+      }
+    }
+    percent = pamixer_percent;
+    muted = pamixer_muted;
+  }
 
-  //Get volume pctg
-  spawn_catchoutput(&getvolume_arg, buffer_pamixeroutput, 8);
-  int percent = atoi(buffer_pamixeroutput);
+  if (percent > 100){
+    percent = 100;
+  }
 
-  //Get mute state
-  spawn_catchoutput(&getmute_arg, buffer_pamixeroutput, 8);
-  if (buffer_pamixeroutput[0] == 't'){ //If volume is muted
+  if (muted){ //If volume is muted
     icon = "";
     strcpy(color, COLOR_DISABLED);
   } else {
@@ -377,7 +586,7 @@ int volume_barmodule(BAR_MODULE_ARGUMENTS){
   return 0;
 }
 
-int keyboard_mapping_clicked(int mask, int button){
+int keyboard_mapping_clicked(int mask, int button, int clicks){
   switch(button){
     case 1:
       switch_keyboard_mapping();
@@ -389,24 +598,29 @@ int keyboard_mapping_clicked(int mask, int button){
 int keyboard_mapping_barmodule(BAR_MODULE_ARGUMENTS){
   // int **a = (int **) args;
   // int kbd = *a[0];
+  //keyboard_mapping is the active XKB group, which other tools may have set beyond our list
+  for (int i = 0; i <= keyboard_mapping; i++){
+    if (keyboard_mappings[i] == NULL){
+      return -1;
+    }
+  }
   snprintf(retstring, bufsize, " %s", keyboard_mappings[keyboard_mapping]);
   return 0;
 }
 
-int brightness_clicked(int mask, int button){
+int brightness_clicked(int mask, int button, int clicks){
   Arg a;
   switch(button){
     case 1:
-      a.v = monitoroffcmd;
-      spawn_waitpid(&a);
+      monitor_off(NULL);
       return 0;
     case 4:
-      a.v = upbrightnesscmd;
-      spawn_waitpid(&a);
+      a.i = +5 * clicks;
+      change_brightness(&a);
       return 0;
     case 5:
-      a.v = downbrightnesscmd;
-      spawn_waitpid(&a);
+      a.i = -5 * clicks;
+      change_brightness(&a);
       return 0;
     default:
       return -1;
@@ -414,16 +628,10 @@ int brightness_clicked(int mask, int button){
   }
 }
 int brightness_barmodule(BAR_MODULE_ARGUMENTS){
-  int file_buffer_len = strlen(BRIGHTNESS_FOLDER) + 32;
-  char brightnessfile_buffer[file_buffer_len];
-  char max_brightnessfile_buffer[file_buffer_len];
-
-  snprintf(brightnessfile_buffer, file_buffer_len, "%s/brightness", BRIGHTNESS_FOLDER);
-  snprintf(max_brightnessfile_buffer, file_buffer_len, "%s/max_brightness", BRIGHTNESS_FOLDER);
-
-  int brightness = read_file_int(brightnessfile_buffer);
-  int max_brightness = read_file_int(max_brightnessfile_buffer);
-  int percent = 100 * brightness / max_brightness;
+  int percent = backlight_percent();
+  if (percent < 0){
+    return -1;
+  }
 
   char progressbar[DEFAULT_PROGRESS_BAR_SIZE];
   progressbar[0] = '\0';
@@ -434,16 +642,7 @@ int brightness_barmodule(BAR_MODULE_ARGUMENTS){
 }
 
 int battery_status_barmodule(BAR_MODULE_ARGUMENTS){
-  int selected_battery = 0;
-  int folderbufsize = strlen(BATTERY_STATUS_FOLDER) + 32;
-  char battery_folder_buf[folderbufsize];
-  char file_buf[folderbufsize + 32];
-
-  char AC_online_file_buf[strlen(AC_ADAPTER_FOLDER) + 32];
-
-  float charge_max;
-  float charge_now;
-  float percentf;
+  PowerStatus power;
   int percent;
 
   int oldstatus;
@@ -452,24 +651,12 @@ int battery_status_barmodule(BAR_MODULE_ARGUMENTS){
 
   _Bool is_charging;
 
-  snprintf(battery_folder_buf, folderbufsize, "%s%d", BATTERY_STATUS_FOLDER, selected_battery);
-
-  snprintf(file_buf, folderbufsize + 32, "%s/%s", battery_folder_buf, "charge_now");
-  charge_now = read_file_float(file_buf);
-
-  snprintf(file_buf, folderbufsize + 32, "%s/%s", battery_folder_buf, "charge_full");
-  charge_max = read_file_float(file_buf);
-
-  snprintf(AC_online_file_buf, strlen(AC_ADAPTER_FOLDER) + 32, "%s%d/online", AC_ADAPTER_FOLDER, 0);
-  is_charging = read_file_int(AC_online_file_buf)? true : false;
-
-  //If battery is at 99.something, show it as 100.
-  percentf = 100*charge_now/charge_max;
-  if (percentf > 99){
-    percent = 100;
-  } else {
-    percent = (int) percentf;
+  //All batteries and adapters found at startup, read in one pass
+  if (power_supply_read(&power) < 0){
+    return -1;
   }
+  percent = power.percent;
+  is_charging = power.on_ac || power.charging;
 
   oldstatus = battery_status;
 
@@ -522,7 +709,11 @@ int battery_status_barmodule(BAR_MODULE_ARGUMENTS){
   //sprintf(retstring, "%s %s %d%%", symbol, battery_progressbar, percent);
 
   //Don't show progressbar on battery
-  sprintf(retstring, "%s %d %%", symbol, percent);
+  if (power.minutes_left >= 0){
+    snprintf(retstring, bufsize, "%s %d %%  %d:%02d", symbol, percent, power.minutes_left / 60, power.minutes_left % 60);
+  } else {
+    snprintf(retstring, bufsize, "%s %d %%", symbol, percent);
+  }
 
   return 0;
 }
@@ -562,7 +753,10 @@ int date_barmodule(BAR_MODULE_ARGUMENTS){
   }
 
   //Bar with seconds
-  // sprintf(retstring, " %s %02d/%s/%d    %02d:%02d:%02d", weekday, timeinfo->tm_mday, month, timeinfo->tm_year+1900, timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+  if (BAR_DATE_SECONDS){
+    sprintf(retstring, " %s %02d/%s/%d    %02d:%02d:%02d", weekday, timeinfo->tm_mday, month, timeinfo->tm_year+1900, timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+    return 0;
+  }
 
   // Without seconds
   sprintf(retstring, " %s %02d %s %d    %02d:%02d", weekday, timeinfo->tm_mday, month, timeinfo->tm_year+1900, timeinfo->tm_hour, timeinfo->tm_min);
@@ -0,0 +1,128 @@
+#include <bar_scheduler.h>
+#include <bar_modules.h>
+#include <event_loop.h>
+#include <power_policy.h>
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+static int timer_fd = -1;
+static bool paused = false;
+static time_t deadlines[BAR_MAX_MODULES];   //Next refresh of each module, wall clock seconds
+
+//Next multiple of period after now, in local time so periods like 1 h land on the hour
+static time_t next_boundary(time_t now, unsigned int period){
+  struct tm tm;
+  long offset;
+
+  localtime_r(&now, &tm);
+  offset = tm.tm_gmtoff;
+  return ((now + offset) / period + 1) * period - offset;
+}
+
+//time() may lag behind the timer expiration by a tick, read the precise clock
+static time_t now_seconds(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec;
+}
+
+//The power policy stretches or tightens every period, except the clock which must stay on time
+static unsigned int module_period(int i){
+  if (bar_modules[i].id == BAR_MODULE_DATE){
+    return bar_modules[i].period;
+  }
+  return power_policy_period(bar_modules[i].period);
+}
+
+static void bar_scheduler_arm(void){
+  struct itimerspec its;
+  time_t next = 0;
+
+  for (int i = 0; bar_modules[i].function != NULL; i++){
+    if (bar_modules[i].period > 0 && (next == 0 || deadlines[i] < next)){
+      next = deadlines[i];
+    }
+  }
+
+  //it_value of 0 disarms the timer
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = next;
+  timerfd_settime(timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL);
+}
+
+void bar_scheduler_rearm(void){
+  time_t now = now_seconds();
+
+  if (timer_fd < 0 || paused){
+    return;
+  }
+  for (int i = 0; bar_modules[i].function != NULL; i++){
+    if (bar_modules[i].period > 0){
+      deadlines[i] = next_boundary(now, module_period(i));
+    }
+  }
+  bar_scheduler_arm();
+}
+
+void bar_scheduler_pause(bool pause){
+  struct itimerspec its;
+
+  if (timer_fd < 0 || paused == pause){
+    return;
+  }
+  paused = pause;
+  if (paused){
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(timer_fd, 0, &its, NULL);
+  } else {
+    bar_scheduler_rearm();
+  }
+}
+
+static void bar_scheduler_handler(int fd, short revents, void *data){
+  unsigned long long expirations;
+  unsigned int due = 0;
+  time_t now;
+
+  //ECANCELED: the clock was set or we resumed. Deadlines are meaningless now, refresh everything
+  if (read(fd, &expirations, sizeof(expirations)) < 0){
+    if (errno == ECANCELED){
+      bar_scheduler_rearm();
+      request_drawbars();
+    }
+    return;
+  }
+
+  if (paused){
+    return;
+  }
+
+  now = now_seconds();
+  for (int i = 0; bar_modules[i].function != NULL; i++){
+    if (bar_modules[i].period > 0 && deadlines[i] <= now){
+      due |= 1u << i;
+      deadlines[i] = next_boundary(now, module_period(i));
+    }
+  }
+  bar_scheduler_arm();
+
+  if (due){
+    request_drawbars_modules(due);
+  }
+}
+
+int bar_scheduler_init(void){
+  if ((timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)) < 0){
+    return -1;
+  }
+  if (event_loop_watch(timer_fd, POLLIN, bar_scheduler_handler, NULL) < 0){
+    close(timer_fd);
+    timer_fd = -1;
+    return -1;
+  }
+  bar_scheduler_rearm();
+  return 0;
+}
@@ -0,0 +1,165 @@
+#include <children.h>
+#include <event_loop.h>
+#include <util.h>
+
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+
+typedef struct WatchedChild {
+  pid_t pid;                              //0: free
+  ChildExited exited;                     //NULL: a thread waits in children_wait()
+  void *data;
+  bool reaped;
+  int status;
+  ChildUsage usage;
+} WatchedChild;
+
+static WatchedChild watched[CHILDREN_MAX_WATCHED];
+static WatchedChild unclaimed[CHILDREN_MAX_UNCLAIMED];
+static int next_unclaimed = 0;
+static pthread_t main_thread;
+static pthread_mutex_t mutex_children = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_children = PTHREAD_COND_INITIALIZER;
+
+static void children_usage(const struct rusage *ru, ChildUsage *usage){
+  usage->utime_us = ru->ru_utime.tv_sec * 1000000LL + ru->ru_utime.tv_usec;
+  usage->stime_us = ru->ru_stime.tv_sec * 1000000LL + ru->ru_stime.tv_usec;
+  usage->maxrss_kb = ru->ru_maxrss;
+}
+
+//Called with mutex_children locked
+static WatchedChild *children_find(WatchedChild *table, int n, pid_t pid){
+  for (int i = 0; i < n; i++){
+    if (table[i].pid == pid){
+      return &table[i];
+    }
+  }
+  return NULL;
+}
+
+static void children_reap(int fd, short revents, void *data){
+  struct signalfd_siginfo si;
+  struct rusage ru;
+  WatchedChild *w, exited;
+  int status;
+  pid_t pid;
+
+  while (read(fd, &si, sizeof(si)) > 0);
+
+  while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0){
+    pthread_mutex_lock(&mutex_children);
+    if ((w = children_find(watched, CHILDREN_MAX_WATCHED, pid)) == NULL){
+      //Maybe a thread is about to wait for it
+      w = &unclaimed[next_unclaimed];
+      next_unclaimed = (next_unclaimed + 1) % CHILDREN_MAX_UNCLAIMED;
+      w->pid = pid;
+      w->exited = NULL;
+    }
+    w->reaped = true;
+    w->status = status;
+    children_usage(&ru, &w->usage);
+
+    if (w->exited == NULL){
+      pthread_cond_broadcast(&cond_children);
+      pthread_mutex_unlock(&mutex_children);
+      continue;
+    }
+    exited = *w;
+    w->pid = 0;
+    pthread_mutex_unlock(&mutex_children);
+
+    exited.exited(pid, exited.status, &exited.usage, exited.data);
+  }
+}
+
+void children_init(void){
+  sigset_t chld;
+  int fd = -1;
+
+  main_thread = pthread_self();
+
+  //Blocked here, every thread created later inherits it. Programs are spawned with an empty mask
+  sigemptyset(&chld);
+  sigaddset(&chld, SIGCHLD);
+  if (sigprocmask(SIG_BLOCK, &chld, NULL) < 0
+  || (fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC)) < 0
+  || event_loop_watch(fd, POLLIN, children_reap, NULL) < 0){
+    die("horizonwm: can't watch SIGCHLD:");
+  }
+
+  //Anything that exited before
+  children_reap(fd, POLLIN, NULL);
+}
+
+int children_watch(pid_t pid, ChildExited exited, void *data){
+  WatchedChild *w;
+
+  pthread_mutex_lock(&mutex_children);
+  if ((w = children_find(watched, CHILDREN_MAX_WATCHED, 0)) == NULL){
+    pthread_mutex_unlock(&mutex_children);
+    return -1;
+  }
+  memset(w, 0, sizeof(*w));
+  w->pid = pid;
+  w->exited = exited;
+  w->data = data;
+  pthread_mutex_unlock(&mutex_children);
+
+  return 0;
+}
+
+int children_wait(pid_t pid, ChildUsage *usage){
+  WatchedChild *w;
+  struct rusage ru;
+  int status = -1;
+
+  pthread_mutex_lock(&mutex_children);
+  if ((w = children_find(unclaimed, CHILDREN_MAX_UNCLAIMED, pid)) != NULL){
+    w->pid = 0;
+    status = w->status;
+    if (usage){
+      *usage = w->usage;
+    }
+    pthread_mutex_unlock(&mutex_children);
+    return status;
+  }
+
+  //The main loop reaps, it can't wait for itself. It doesn't reap while it is here either
+  if (pthread_equal(pthread_self(), main_thread)){
+    pthread_mutex_unlock(&mutex_children);
+    while (wait4(pid, &status, 0, &ru) < 0){
+      if (errno != EINTR){
+        return -1;
+      }
+    }
+    if (usage){
+      children_usage(&ru, usage);
+    }
+    return status;
+  }
+
+  if ((w = children_find(watched, CHILDREN_MAX_WATCHED, 0)) == NULL){
+    pthread_mutex_unlock(&mutex_children);
+    return -1;
+  }
+  memset(w, 0, sizeof(*w));
+  w->pid = pid;
+  while (!w->reaped){
+    pthread_cond_wait(&cond_children, &mutex_children);
+  }
+  status = w->status;
+  if (usage){
+    *usage = w->usage;
+  }
+  w->pid = 0;
+  pthread_mutex_unlock(&mutex_children);
+
+  return status;
+}
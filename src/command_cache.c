@@ -0,0 +1,247 @@
+#include <command_cache.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef struct CacheWaiter {
+  SpawnDone done;
+  void *data;
+} CacheWaiter;
+
+typedef struct CachedCommand {
+  char key[COMMAND_CACHE_KEYLEN];         //argv, separated by \x1f
+  bool running;
+  bool async;                             //Run by spawn_async(): waiters are called from the main loop
+  bool stale;                             //Invalidated while running, its result isn't kept
+  unsigned int runs;                      //Callers sharing a run wait for this to finish
+  unsigned int ttl_ms;
+  struct timespec finished;
+  int status;
+  char output[COMMAND_CACHE_OUTPUT];
+  CacheWaiter waiters[COMMAND_CACHE_MAX_WAITERS];
+  int nwaiters;
+} CachedCommand;
+
+static CachedCommand cache[COMMAND_CACHE_ENTRIES];
+static pthread_mutex_t mutex_command_cache = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_command_cache = PTHREAD_COND_INITIALIZER;
+
+static bool command_cache_key(const char *const argv[], char *key){
+  size_t len = 0, l;
+
+  for (int i = 0; argv[i] != NULL; i++){
+    l = strlen(argv[i]);
+    if (len + l + 1 >= COMMAND_CACHE_KEYLEN){
+      return false;
+    }
+    memcpy(key + len, argv[i], l);
+    len += l;
+    key[len++] = '\x1f';
+  }
+  key[len] = '\0';
+  return true;
+}
+
+static bool command_cache_fresh(const CachedCommand *c, unsigned int ttl_ms){
+  struct timespec now;
+  long long age_ms;
+
+  if (c->running || c->stale || (c->finished.tv_sec == 0 && c->finished.tv_nsec == 0)){
+    return false;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  age_ms = (now.tv_sec - c->finished.tv_sec) * 1000LL + (now.tv_nsec - c->finished.tv_nsec) / 1000000;
+  return age_ms < ttl_ms;
+}
+
+//Called with mutex_command_cache locked. The entry for key, or the least recently finished idle one
+static CachedCommand *command_cache_entry(const char *key){
+  CachedCommand *oldest = NULL;
+
+  for (int i = 0; i < COMMAND_CACHE_ENTRIES; i++){
+    if (strcmp(cache[i].key, key) == 0){
+      return &cache[i];
+    }
+  }
+  for (int i = 0; i < COMMAND_CACHE_ENTRIES; i++){
+    if (cache[i].running){
+      continue;
+    }
+    if (oldest == NULL || cache[i].finished.tv_sec < oldest->finished.tv_sec
+    || (cache[i].finished.tv_sec == oldest->finished.tv_sec && cache[i].finished.tv_nsec < oldest->finished.tv_nsec)){
+      oldest = &cache[i];
+    }
+  }
+  if (oldest != NULL){
+    memset(oldest, 0, sizeof(*oldest));
+    strcpy(oldest->key, key);
+  }
+  return oldest;
+}
+
+//Called with mutex_command_cache locked
+static void command_cache_store(CachedCommand *c, int status, const char *output){
+  c->running = false;
+  c->status = status;
+  if (output != c->output){
+    snprintf(c->output, sizeof(c->output), "%s", output);
+  }
+  if (c->stale){
+    c->stale = false;
+    c->finished.tv_sec = c->finished.tv_nsec = 0;
+  } else {
+    clock_gettime(CLOCK_MONOTONIC, &c->finished);
+  }
+  pthread_cond_broadcast(&cond_command_cache);
+}
+
+int command_cache_output(const char *const argv[], unsigned int ttl_ms, char *buf, size_t size){
+  char key[COMMAND_CACHE_KEYLEN];
+  char output[COMMAND_CACHE_OUTPUT];
+  CachedCommand *c;
+  unsigned int run;
+  int status;
+
+  if (!command_cache_key(argv, key)){
+    return spawn_capture(argv, buf, size);
+  }
+
+  pthread_mutex_lock(&mutex_command_cache);
+  for (;;){
+    c = command_cache_entry(key);
+    //Runs from the main loop can't be waited for here, and invalidated ones are already old
+    if (c == NULL || (c->running && (c->async || c->stale))){
+      pthread_mutex_unlock(&mutex_command_cache);
+      return spawn_capture(argv, buf, size);
+    }
+    if (!c->running){
+      break;
+    }
+
+    //Somebody else runs it now: share its result
+    run = c->runs;
+    while (c->running && c->runs == run && strcmp(c->key, key) == 0){
+      pthread_cond_wait(&cond_command_cache, &mutex_command_cache);
+    }
+    if (!c->running && c->runs == run && strcmp(c->key, key) == 0){
+      snprintf(buf, size, "%s", c->output);
+      status = c->status;
+      pthread_mutex_unlock(&mutex_command_cache);
+      return status;
+    }
+  }
+  if (command_cache_fresh(c, ttl_ms)){
+    snprintf(buf, size, "%s", c->output);
+    status = c->status;
+    pthread_mutex_unlock(&mutex_command_cache);
+    return status;
+  }
+  c->running = true;
+  c->runs++;
+  c->async = false;
+  c->ttl_ms = ttl_ms;
+  pthread_mutex_unlock(&mutex_command_cache);
+
+  status = spawn_capture(argv, output, sizeof(output));
+
+  pthread_mutex_lock(&mutex_command_cache);
+  command_cache_store(c, status, output);
+  pthread_mutex_unlock(&mutex_command_cache);
+
+  snprintf(buf, size, "%s", output);
+  return status;
+}
+
+static void command_cache_async_done(int status, const char *output, void *data){
+  CachedCommand *c = (CachedCommand *) data;
+  CacheWaiter waiters[COMMAND_CACHE_MAX_WAITERS];
+  char result[COMMAND_CACHE_OUTPUT];
+  int nwaiters;
+
+  pthread_mutex_lock(&mutex_command_cache);
+  command_cache_store(c, status, output);
+  nwaiters = c->nwaiters;
+  memcpy(waiters, c->waiters, nwaiters * sizeof(CacheWaiter));
+  c->nwaiters = 0;
+  pthread_mutex_unlock(&mutex_command_cache);
+
+  //Callers may ask for it again from done(), or for anything else
+  snprintf(result, sizeof(result), "%s", output);
+  for (int i = 0; i < nwaiters; i++){
+    waiters[i].done(status, result, waiters[i].data);
+  }
+}
+
+int command_cache_async(const char *const argv[], unsigned int ttl_ms, SpawnDone done, void *data){
+  char key[COMMAND_CACHE_KEYLEN];
+  char output[COMMAND_CACHE_OUTPUT];
+  CachedCommand *c;
+  int status;
+
+  if (!command_cache_key(argv, key)){
+    return spawn_async(argv, NULL, true, done, data) != NULL ? 0 : -1;
+  }
+
+  pthread_mutex_lock(&mutex_command_cache);
+  c = command_cache_entry(key);
+  if (c != NULL && c->running && c->async && !c->stale && c->nwaiters < COMMAND_CACHE_MAX_WAITERS){
+    c->waiters[c->nwaiters].done = done;
+    c->waiters[c->nwaiters].data = data;
+    c->nwaiters++;
+    pthread_mutex_unlock(&mutex_command_cache);
+    return 0;
+  }
+  if (c == NULL || c->running){
+    pthread_mutex_unlock(&mutex_command_cache);
+    return spawn_async(argv, NULL, true, done, data) != NULL ? 0 : -1;
+  }
+  if (command_cache_fresh(c, ttl_ms)){
+    snprintf(output, sizeof(output), "%s", c->output);
+    status = c->status;
+    pthread_mutex_unlock(&mutex_command_cache);
+    done(status, output, data);
+    return 0;
+  }
+
+  c->running = true;
+  c->runs++;
+  c->async = true;
+  c->ttl_ms = ttl_ms;
+  c->waiters[0].done = done;
+  c->waiters[0].data = data;
+  c->nwaiters = 1;
+  pthread_mutex_unlock(&mutex_command_cache);
+
+  if (spawn_async(argv, NULL, true, command_cache_async_done, c) == NULL){
+    pthread_mutex_lock(&mutex_command_cache);
+    c->running = false;
+    c->nwaiters = 0;
+    c->finished.tv_sec = c->finished.tv_nsec = 0;
+    pthread_cond_broadcast(&cond_command_cache);
+    pthread_mutex_unlock(&mutex_command_cache);
+    return -1;
+  }
+  return 0;
+}
+
+void command_cache_invalidate(const char *const argv[]){
+  char key[COMMAND_CACHE_KEYLEN];
+
+  if (!command_cache_key(argv, key)){
+    return;
+  }
+  pthread_mutex_lock(&mutex_command_cache);
+  for (int i = 0; i < COMMAND_CACHE_ENTRIES; i++){
+    if (strcmp(cache[i].key, key) == 0){
+      if (cache[i].running){
+        cache[i].stale = true;
+      } else {
+        cache[i].finished.tv_sec = cache[i].finished.tv_nsec = 0;
+      }
+    }
+  }
+  pthread_mutex_unlock(&mutex_command_cache);
+}
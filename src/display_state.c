@@ -0,0 +1,223 @@
+#include <display_state.h>
+#include <event_loop.h>
+#include <bar_scheduler.h>
+#include <power_policy.h>
+
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <X11/extensions/scrnsaver.h>
+#include <X11/extensions/dpms.h>
+
+static Display *display = NULL;
+static int saver_event_base = -1;
+static bool has_dpms = false;
+static XScreenSaverInfo *saver_info = NULL;
+static int timer_fd = -1;
+
+static pthread_mutex_t mutex_display = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_display;
+static bool blanked = false;
+static bool bars_hidden = false;
+static bool unseen = false;         //blanked || bars_hidden. Nothing refreshes
+static bool saver_active = false;
+static pid_t locker_pid = 0;
+static unsigned int wakeups = 0;    //Incremented on every unseen -> seen transition
+
+static void display_state_arm(unsigned int seconds){
+  struct itimerspec its;
+
+  if (timer_fd < 0){
+    return;
+  }
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_sec = seconds > 0 ? seconds : 1;
+  timerfd_settime(timer_fd, 0, &its, NULL);
+}
+
+//Seconds until the earliest DPMS timeout, given how long the user has been idle
+static unsigned int dpms_next_timeout(void){
+  CARD16 standby, suspend, off, timeout = 0;
+  unsigned long idle;
+
+  if (!has_dpms || !DPMSGetTimeouts(display, &standby, &suspend, &off)){
+    return DISPLAY_AWAKE_POLL;
+  }
+  if (standby && (!timeout || standby < timeout)) timeout = standby;
+  if (suspend && (!timeout || suspend < timeout)) timeout = suspend;
+  if (off     && (!timeout || off     < timeout)) timeout = off;
+  if (!timeout || saver_info == NULL || !XScreenSaverQueryInfo(display, DefaultRootWindow(display), saver_info)){
+    return DISPLAY_AWAKE_POLL;
+  }
+
+  idle = saver_info->idle / 1000;
+  if (idle >= timeout){
+    return 1;
+  }
+  return timeout - idle < DISPLAY_AWAKE_POLL ? timeout - idle + 1 : DISPLAY_AWAKE_POLL;
+}
+
+//Called with mutex_display locked, which it releases
+static void display_state_update(void){
+  bool now_unseen = blanked || bars_hidden;
+
+  if (unseen == now_unseen){
+    pthread_mutex_unlock(&mutex_display);
+    return;
+  }
+  unseen = now_unseen;
+  if (!unseen){
+    wakeups++;
+    pthread_cond_broadcast(&cond_display);
+  }
+  pthread_mutex_unlock(&mutex_display);
+
+  //Nothing is refreshed while unseen. When the bar is seen again, everything is at once
+  bar_scheduler_pause(now_unseen);
+  if (!now_unseen){
+    request_drawbars();
+  }
+}
+
+static void display_state_set(bool now_blanked){
+  pthread_mutex_lock(&mutex_display);
+  blanked = now_blanked;
+  display_state_update();
+}
+
+void display_state_set_bars_hidden(bool hidden){
+  pthread_mutex_lock(&mutex_display);
+  bars_hidden = hidden;
+  display_state_update();
+}
+
+void display_state_check(void){
+  CARD16 power_level;
+  BOOL dpms_enabled;
+  bool locked = false;
+  bool off = false;
+
+  if (has_dpms && DPMSInfo(display, &power_level, &dpms_enabled)){
+    off = dpms_enabled && power_level != DPMSModeOn;
+  }
+
+  pthread_mutex_lock(&mutex_display);
+  if (locker_pid > 0){
+    if (kill(locker_pid, 0) == 0){
+      locked = true;
+    } else {
+      locker_pid = 0;
+    }
+  }
+  off = off || saver_active || locked;
+  pthread_mutex_unlock(&mutex_display);
+
+  display_state_set(off);
+  display_state_arm(off ? DISPLAY_BLANKED_POLL : dpms_next_timeout());
+}
+
+static void display_state_handler(int fd, short revents, void *data){
+  unsigned long long expirations;
+
+  if (read(fd, &expirations, sizeof(expirations)) < 0){
+    return;
+  }
+  display_state_check();
+}
+
+void display_state_event(XEvent *e){
+  XScreenSaverNotifyEvent *ev = (XScreenSaverNotifyEvent *) e;
+
+  pthread_mutex_lock(&mutex_display);
+  saver_active = ev->state == ScreenSaverOn || ev->state == ScreenSaverCycle;
+  pthread_mutex_unlock(&mutex_display);
+
+  display_state_check();
+}
+
+int display_state_init(Display *dpy, Window root){
+  pthread_condattr_t attr;
+  int error_base, major, minor;
+
+  display = dpy;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&cond_display, &attr);
+  pthread_condattr_destroy(&attr);
+
+  has_dpms = DPMSQueryExtension(dpy, &major, &minor) && DPMSCapable(dpy);
+
+  if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) >= 0){
+    event_loop_watch(timer_fd, POLLIN, display_state_handler, NULL);
+  }
+
+  if (XScreenSaverQueryExtension(dpy, &saver_event_base, &error_base)){
+    saver_info = XScreenSaverAllocInfo();
+    XScreenSaverSelectInput(dpy, root, ScreenSaverNotifyMask);
+  } else {
+    saver_event_base = -1;
+  }
+
+  display_state_check();
+  return saver_event_base < 0 ? -1 : saver_event_base + ScreenSaverNotify;
+}
+
+bool display_awake(void){
+  bool awake;
+
+  pthread_mutex_lock(&mutex_display);
+  awake = !unseen;
+  pthread_mutex_unlock(&mutex_display);
+
+  return awake;
+}
+
+void display_state_poll_soon(void){
+  display_state_arm(1);
+}
+
+void display_state_set_locker(pid_t pid){
+  pthread_mutex_lock(&mutex_display);
+  locker_pid = pid;
+  pthread_mutex_unlock(&mutex_display);
+
+  display_state_poll_soon();
+}
+
+void display_sleep(unsigned int seconds){
+  struct timespec start, deadline;
+  unsigned int start_wakeups;
+  bool timed_out = false;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  pthread_mutex_lock(&mutex_display);
+  start_wakeups = wakeups;
+  for (;;){
+    if (wakeups != start_wakeups){      //Bar just got seen again, refresh now
+      break;
+    }
+    if (unseen){
+      pthread_cond_wait(&cond_display, &mutex_display);
+      continue;
+    }
+    if (timed_out){
+      break;
+    }
+    //Recomputed on every wake up, the power policy may have changed meanwhile
+    deadline = start;
+    deadline.tv_sec += power_policy_sleep(seconds);
+    timed_out = pthread_cond_timedwait(&cond_display, &mutex_display, &deadline) == ETIMEDOUT;
+  }
+  pthread_mutex_unlock(&mutex_display);
+}
+
+void display_sleep_reschedule(void){
+  pthread_mutex_lock(&mutex_display);
+  pthread_cond_broadcast(&cond_display);
+  pthread_mutex_unlock(&mutex_display);
+}
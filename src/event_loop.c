@@ -0,0 +1,125 @@
+#include <event_loop.h>
+
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "util.h"
+
+typedef struct EventLoopWatch {
+  int fd;
+  short events;
+  EventLoopFunction function;
+  void *data;
+} EventLoopWatch;
+
+static EventLoopWatch watches[EVENT_LOOP_MAX_WATCHES];
+static int nwatches = 0;
+
+//Self pipe used by other threads to wake up the main loop
+static int wakeup_pipe[2] = {-1, -1};
+static unsigned int redraw_requested = 0;   //Mask of modules to refresh before redrawing
+static pthread_mutex_t mutex_event_loop = PTHREAD_MUTEX_INITIALIZER;
+
+void event_loop_init(void){
+  if (pipe(wakeup_pipe) < 0){
+    die("horizonwm: pipe failed on event_loop_init:");
+  }
+  for (int i = 0; i < 2; i++){
+    fcntl(wakeup_pipe[i], F_SETFL, O_NONBLOCK);
+    fcntl(wakeup_pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+}
+
+int event_loop_watch(int fd, short events, EventLoopFunction function, void *data){
+  if (fd < 0 || nwatches >= EVENT_LOOP_MAX_WATCHES){
+    return -1;
+  }
+
+  watches[nwatches].fd = fd;
+  watches[nwatches].events = events;
+  watches[nwatches].function = function;
+  watches[nwatches].data = data;
+  nwatches++;
+
+  return 0;
+}
+
+void event_loop_unwatch(int fd){
+  for (int i = 0; i < nwatches; i++){
+    if (watches[i].fd == fd){
+      watches[i] = watches[nwatches - 1];
+      nwatches--;
+      return;
+    }
+  }
+}
+
+void event_loop_wait(int xfd){
+  struct pollfd pfds[EVENT_LOOP_MAX_WATCHES + 2];
+  EventLoopWatch snapshot[EVENT_LOOP_MAX_WATCHES];
+  int nsnapshot = nwatches;
+  char drain[64];
+
+  pfds[0].fd = xfd;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = wakeup_pipe[0];
+  pfds[1].events = POLLIN;
+  for (int i = 0; i < nsnapshot; i++){
+    snapshot[i] = watches[i];
+    pfds[i + 2].fd = watches[i].fd;
+    pfds[i + 2].events = watches[i].events;
+  }
+
+  if (poll(pfds, nsnapshot + 2, -1) < 0){
+    if (errno != EINTR){
+      die("horizonwm: poll failed on event_loop_wait:");
+    }
+    return;
+  }
+
+  if (pfds[1].revents & POLLIN){
+    while (read(wakeup_pipe[0], drain, sizeof(drain)) > 0);
+  }
+
+  //Watches may be removed by the callbacks themselves, so only dispatch the ones still registered
+  for (int i = 0; i < nsnapshot; i++){
+    if (pfds[i + 2].revents == 0){
+      continue;
+    }
+    for (int j = 0; j < nwatches; j++){
+      if (watches[j].fd == snapshot[i].fd && watches[j].function == snapshot[i].function){
+        snapshot[i].function(snapshot[i].fd, pfds[i + 2].revents, snapshot[i].data);
+        break;
+      }
+    }
+  }
+}
+
+void request_drawbars(void){
+  request_drawbars_modules(~0u);
+}
+
+void request_drawbars_modules(unsigned int modules){
+  char c = 0;
+
+  pthread_mutex_lock(&mutex_event_loop);
+  if (!redraw_requested){
+    write(wakeup_pipe[1], &c, 1);
+  }
+  redraw_requested |= modules;
+  pthread_mutex_unlock(&mutex_event_loop);
+}
+
+unsigned int event_loop_redraw_pending(void){
+  unsigned int r;
+
+  pthread_mutex_lock(&mutex_event_loop);
+  r = redraw_requested;
+  redraw_requested = 0;
+  pthread_mutex_unlock(&mutex_event_loop);
+
+  return r;
+}
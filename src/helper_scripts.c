@@ -2,53 +2,514 @@
 #include <horizonwm_type_definitions.h>
 #include <spawn_programs.h>
 #include <global_vars.h>
+#include <event_loop.h>
+#include <pulse_volume.h>
+#include <pacman_db.h>
+#include <display_state.h>
+#include <bar_modules.h>
+#include <backlight.h>
+#include <command_cache.h>
+#include <spawn_stats.h>
 
 #include <stdio.h>
 #include <dirent.h>
 #include <string.h>
 #include <time.h>
 #include <sys/wait.h>
+#include <sys/timerfd.h>
 #include <fcntl.h>
 #include <unistd.h>
-
+#include <X11/XKBlib.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+//Opt in with make IO_URING=1. pread() is faster for sysfs and /proc attributes on the kernels measured
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IO_URING)
+#define HAVE_IO_URING
+#endif
+
+//Reads whole (small) file into buf, NUL terminated. Returns -1 on error
+int read_file_string(const char *file, char *buf, size_t size){
+  ssize_t n;
+  int fd = open(file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0){
+    return -1;
+  }
+  n = read(fd, buf, size - 1);
+  close(fd);
+  if (n < 0){
+    return -1;
+  }
+  buf[n] = '\0';
+  return 0;
+}
 float read_file_float(const char *file){
   char buf[128];
-  int fd = open(file, O_RDONLY);
-  read(fd, buf, 128);
-  close(fd);
+  if (read_file_string(file, buf, sizeof(buf)) < 0){
+    return 0;
+  }
   return atof(buf);
 }
 int read_file_int(const char *file){
   char buf[128];
-  int fd = open(file, O_RDONLY);
-  read(fd, buf, 128);
-  close(fd);
+  if (read_file_string(file, buf, sizeof(buf)) < 0){
+    return 0;
+  }
   return atoi(buf);
 }
 
-void switch_keyboard_mapping(){
-  const char *map = keyboard_mappings[0];
-  int num = 0;
-  Arg arg;
+//BATCHED READS
+#define IO_URING_ENTRIES 32
+#define READ_PENDING     (-EINPROGRESS)   //Result of a request not read yet
+
+#ifdef HAVE_IO_URING
+typedef struct IoUring {
+  int fd;
+  unsigned entries;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+} IoUring;
+
+static IoUring ring;
+#endif
+
+static int ring_state = 0;    //0 = not tried yet, 1 = io_uring ready, -1 = using pread()
+static pthread_mutex_t mutex_read_batch = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef HAVE_IO_URING
+static int io_uring_init(){
+  struct io_uring_params p;
+  size_t sqsize, cqsize;
+  char *sq = MAP_FAILED, *cq = MAP_FAILED;
+
+  memset(&p, 0, sizeof(p));
+  if ((ring.fd = syscall(__NR_io_uring_setup, IO_URING_ENTRIES, &p)) < 0){
+    return -1;
+  }
+
+  sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP){
+    sqsize = cqsize = sqsize > cqsize ? sqsize : cqsize;
+  }
+
+  sq = mmap(NULL, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED){
+    goto io_uring_init_error;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP){
+    cq = sq;
+  } else if ((cq = mmap(NULL, cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING)) == MAP_FAILED){
+    goto io_uring_init_error;
+  }
+  ring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+  if (ring.sqes == MAP_FAILED){
+    goto io_uring_init_error;
+  }
+
+  ring.entries  = p.sq_entries;
+  ring.sq_head  = (unsigned *) (sq + p.sq_off.head);
+  ring.sq_tail  = (unsigned *) (sq + p.sq_off.tail);
+  ring.sq_mask  = (unsigned *) (sq + p.sq_off.ring_mask);
+  ring.sq_array = (unsigned *) (sq + p.sq_off.array);
+  ring.cq_head  = (unsigned *) (cq + p.cq_off.head);
+  ring.cq_tail  = (unsigned *) (cq + p.cq_off.tail);
+  ring.cq_mask  = (unsigned *) (cq + p.cq_off.ring_mask);
+  ring.cqes     = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+  return 0;
+
+  io_uring_init_error:
+  //Unmaps whatever got mapped before the failure
+  if (cq != MAP_FAILED && cq != sq){
+    munmap(cq, cqsize);
+  }
+  if (sq != MAP_FAILED){
+    munmap(sq, sqsize);
+  }
+  close(ring.fd);
+  return -1;
+}
+
+//Submits the requests not marked no_ring in chunks of the ring size. One io_uring_enter() per chunk.
+//Those the kernel didn't take are left with result READ_PENDING. Returns -1 if io_uring must not be used
+static int io_uring_read_batch(ReadRequest *reqs, int n){
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+  unsigned tail, head, idx;
+  int chunk, submitted, reaped, unsupported = 0, i = 0;
+  long ret;
+
+  while (i < n){
+    tail = *ring.sq_tail;
+    for (chunk = 0; i < n && chunk < (int) ring.entries; i++){
+      if (reqs[i].no_ring){
+        continue;
+      }
+      idx = tail & *ring.sq_mask;
+      sqe = &ring.sqes[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = reqs[i].fd;
+      sqe->addr = (unsigned long) reqs[i].buf;
+      sqe->len = reqs[i].len;
+      sqe->off = reqs[i].offset;
+      sqe->user_data = i;
+      ring.sq_array[idx] = idx;
+      tail++;
+      chunk++;
+    }
+    if (chunk == 0){
+      break;
+    }
+    __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+    while ((ret = syscall(__NR_io_uring_enter, ring.fd, chunk, chunk, IORING_ENTER_GETEVENTS, NULL, 0)) < 0 && errno == EINTR);
+    submitted = ret < 0 ? 0 : (int) ret;
+
+    //Short submit (-EAGAIN, -EBUSY, or an entry that stopped it): the rest is taken back and read with pread()
+    if (submitted < chunk){
+      __atomic_store_n(ring.sq_tail, __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+
+    //Only what was submitted completes. Waiting for more would block forever
+    for (reaped = 0; reaped < submitted; ){
+      head = *ring.cq_head;
+      if (head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)){
+        //Interrupted before every read completed
+        if (syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR){
+          return -1;
+        }
+        continue;
+      }
+      cqe = &ring.cqes[head & *ring.cq_mask];
+      reqs[cqe->user_data].result = cqe->res;
+      if (cqe->res == -EINVAL){   //IORING_OP_READ needs Linux 5.6
+        unsupported = 1;
+      }
+      __atomic_store_n(ring.cq_head, head + 1, __ATOMIC_RELEASE);
+      reaped++;
+    }
+
+    if (ret < 0 && errno != EAGAIN && errno != EBUSY){
+      return -1;
+    }
+    if (submitted < chunk){
+      break;
+    }
+  }
+
+  return unsupported ? -1 : 0;
+}
+#endif //HAVE_IO_URING
 
-  while (map != NULL){
+bool read_batch_uses_io_uring(void){
+  return ring_state == 1;
+}
+
+int read_batch(ReadRequest *reqs, int n){
+  ssize_t r;
+  int nread = 0;
+
+  pthread_mutex_lock(&mutex_read_batch);
+
+  for (int i = 0; i < n; i++){
+    reqs[i].result = READ_PENDING;
+  }
+
+#ifdef HAVE_IO_URING
+  if (ring_state == 0){
+    ring_state = io_uring_init() == 0 ? 1 : -1;
+  }
+  if (ring_state == 1 && io_uring_read_batch(reqs, n) < 0){
+    ring_state = -1;
+  }
+#else
+  ring_state = -1;
+#endif
+
+  //Fallback, one pread() per request the ring didn't read. With io_uring disabled, every one of them
+  for (int i = 0; i < n; i++){
+    if (ring_state != 1 || reqs[i].result == READ_PENDING){
+      r = pread(reqs[i].fd, reqs[i].buf, reqs[i].len, reqs[i].offset);
+      reqs[i].result = r < 0 ? -errno : r;
+    }
+  }
+
+  pthread_mutex_unlock(&mutex_read_batch);
+
+  for (int i = 0; i < n; i++){
+    if (reqs[i].result >= 0){
+      nread++;
+    }
+  }
+  return nread;
+}
+
+static int count_keyboard_mappings(){
+  int num = 0;
+  while (keyboard_mappings[num] != NULL){
     num++;
-    map = keyboard_mappings[num];
   }
+  return num < XkbNumKbdGroups ? num : XkbNumKbdGroups;   //XKB supports up to 4 groups
+}
+
+//Group switch is done by the X server. keyboard_mapping gets updated on XkbStateNotify
+void switch_keyboard_mapping(){
+  int num = count_keyboard_mappings();
 
-  keyboard_mapping = (keyboard_mapping + 1) % num;
+  if (num == 0){
+    return;
+  }
 
-  arg.v = keyboard_mappings[keyboard_mapping];
-  scripts_set_keyboard_mapping(&arg);
+  XkbLockGroup(dpy, XkbUseCoreKbd, (keyboard_mapping + 1) % num);
+  XFlush(dpy);
 }
-void scripts_set_keyboard_mapping(const Arg *a){
-  const char *mapping = a->v;
+//Loads every mapping of keyboard_mappings[] as a group of one keymap, so switching never recompiles it. Waits for it
+void scripts_load_keyboard_mappings(){
+  char layouts[256] = "";
+  int num = count_keyboard_mappings();
+
+  for (int i = 0; i < num; i++){
+    if (i > 0){
+      strncat(layouts, ",", sizeof(layouts) - strlen(layouts) - 1);
+    }
+    strncat(layouts, keyboard_mappings[i], sizeof(layouts) - strlen(layouts) - 1);
+  }
 
-  const char *cmd[] = {"setxkbmap", mapping, NULL};
+  const char *cmd[] = {"setxkbmap", "-layout", layouts, NULL};
   Arg arg;
   arg.v = cmd;
 
-  spawn(&arg);
+  spawn_waitpid(&arg);
+}
+
+//VOLUME
+//Asynchronous through the PulseAudio connection. pamixer is only used when it isn't available
+void setmpcstatus(const Arg *arg_unused);   //Defined on horizonwm.c
+
+static void volume_reconcile(void){
+  volume_expect_clear();
+  command_cache_invalidate(getvolumecmd);
+  command_cache_invalidate(getmutecmd);
+  request_drawbars_modules(bar_modules_mask(BAR_MODULE_VOLUME));
+}
+
+static void brightness_reconcile(void){
+  backlight_invalidate();
+  request_drawbars_modules(bar_modules_mask(BAR_MODULE_BRIGHTNESS));
+}
+
+#define ADJUST_MAX_ARGS 16
+
+//Volume and brightness steps. The ones requested while the previous command still runs, or within
+//ADJUST_COALESCE_MS of each other, are added up and applied by a single command
+typedef struct Adjustment {
+  const char **upcmd;           //"%d" in an argument is replaced by the step
+  const char **downcmd;
+  void (*reconcile)(void);      //Refreshes the module with the real state
+  int pending;                  //Step not applied yet, in percent
+  bool running;                 //A command is in flight
+  char step[16];
+  const char *cmd[ADJUST_MAX_ARGS];
+} Adjustment;
+
+static Adjustment adjust_volume     = {upvolumecmd,     downvolume,         volume_reconcile};
+static Adjustment adjust_brightness = {upbrightnesscmd, downbrightnesscmd,  brightness_reconcile};
+static Adjustment *adjustments[]    = {&adjust_volume, &adjust_brightness, NULL};
+
+static void adjust_done(Adjustment *adj);
+static void adjust_exited(int status, const char *output, void *data);
+
+static pthread_mutex_t mutex_adjust = PTHREAD_MUTEX_INITIALIZER;
+static int adjust_timer_fd = -1;
+static bool adjust_timer_armed = false;
+
+static void adjust_arm(long nsec){
+  struct itimerspec its;
+
+  memset(&its, 0, sizeof(its));
+  its.it_value.tv_nsec = nsec > 0 ? nsec : 1;
+  timerfd_settime(adjust_timer_fd, 0, &its, NULL);
+}
+
+//Starts the command for whatever accumulated, unless one is still running
+static void adjust_flush(Adjustment *adj){
+  const char **template;
+  int step, i;
+
+  pthread_mutex_lock(&mutex_adjust);
+  if (adj->running || adj->pending == 0){
+    pthread_mutex_unlock(&mutex_adjust);
+    return;
+  }
+  step = adj->pending;
+  adj->pending = 0;
+  adj->running = true;
+
+  template = step > 0 ? adj->upcmd : adj->downcmd;
+  for (i = 0; template[i] != NULL && i < ADJUST_MAX_ARGS - 1; i++){
+    adj->cmd[i] = template[i];
+    if (strchr(template[i], '%')){
+      snprintf(adj->step, sizeof(adj->step), template[i], step > 0 ? step : -step);
+      adj->cmd[i] = adj->step;
+    }
+  }
+  adj->cmd[i] = NULL;
+  pthread_mutex_unlock(&mutex_adjust);
+
+  //Its exit reconciles, from the event loop. If it didn't start, right now
+  if (spawn_async(adj->cmd, NULL, false, adjust_exited, adj) == NULL){
+    adjust_done(adj);
+  }
+}
+
+static void adjust_timer_handler(int fd, short revents, void *data){
+  unsigned long long expirations;
+
+  if (read(fd, &expirations, sizeof(expirations)) < 0){
+    return;
+  }
+  pthread_mutex_lock(&mutex_adjust);
+  adjust_timer_armed = false;
+  pthread_mutex_unlock(&mutex_adjust);
+
+  for (int i = 0; adjustments[i] != NULL; i++){
+    adjust_flush(adjustments[i]);
+  }
+}
+
+//Main thread
+static void adjust_add(Adjustment *adj, int delta){
+  bool arm;
+
+  if (adjust_timer_fd < 0){
+    adjust_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (adjust_timer_fd >= 0 && event_loop_watch(adjust_timer_fd, POLLIN, adjust_timer_handler, NULL) < 0){
+      close(adjust_timer_fd);
+      adjust_timer_fd = -1;
+    }
+  }
+
+  pthread_mutex_lock(&mutex_adjust);
+  adj->pending += delta;
+  arm = !adj->running && !adjust_timer_armed && adjust_timer_fd >= 0;
+  adjust_timer_armed = adjust_timer_armed || arm;
+  pthread_mutex_unlock(&mutex_adjust);
+
+  if (adjust_timer_fd < 0){
+    adjust_flush(adj);
+  } else if (arm){
+    adjust_arm(ADJUST_COALESCE_MS * 1000000L);
+  }
+}
+
+//The command finished, send what accumulated meanwhile
+static void adjust_done(Adjustment *adj){
+  bool kick, settled;
+
+  pthread_mutex_lock(&mutex_adjust);
+  adj->running = false;
+  settled = adj->pending == 0;
+  kick = !settled && !adjust_timer_armed && adjust_timer_fd >= 0;
+  adjust_timer_armed = adjust_timer_armed || kick;
+  pthread_mutex_unlock(&mutex_adjust);
+
+  //Only once everything was applied. Until then the module keeps showing the expected state
+  if (settled){
+    adj->reconcile();
+  }
+  if (adjust_timer_fd < 0){
+    adjust_flush(adj);
+  } else if (kick){
+    adjust_arm(0);
+  }
+}
+
+static void adjust_exited(int status, const char *output, void *data){
+  adjust_done((Adjustment *) data);
+}
+
+static void mpd_reconcile(void){
+  pthread_mutex_lock(&mutex_mpc);
+  mpd_actions_pending--;
+  pthread_mutex_unlock(&mutex_mpc);
+
+  command_cache_invalidate(mpc_status);
+  setmpcstatus(NULL);
+}
+
+static void mpd_exited(int status, const char *output, void *data){
+  mpd_reconcile();
+}
+
+static void mute_exited(int status, const char *output, void *data){
+  volume_reconcile();
+}
+
+void change_volume(const Arg *a){
+  //PulseAudio updates its cached state itself, the subscription reconciles
+  if (pulse_volume_change(a->i) == 0){
+    volume_reconcile();
+    return;
+  }
+  //pamixer: shown at once, on top of the steps still pending
+  volume_expect(a->i);
+  adjust_add(&adjust_volume, a->i);
+}
+void toggle_mute(const Arg *a){
+  if (pulse_volume_toggle_mute() == 0){
+    volume_reconcile();
+    return;
+  }
+  volume_expect_mute();
+  if (spawn_async(mutevolume, NULL, false, mute_exited, NULL) == NULL){
+    volume_reconcile();
+  }
+}
+
+void change_brightness(const Arg *a){
+  int percent;
+
+  //Written in process. The bar shows the target while it fades
+  if (backlight_step(a->i) == 0){
+    request_drawbars_modules(bar_modules_mask(BAR_MODULE_BRIGHTNESS));
+    return;
+  }
+
+  percent = backlight_percent();
+
+  if (percent >= 0){
+    backlight_expect(percent + a->i);
+    request_drawbars_modules(bar_modules_mask(BAR_MODULE_BRIGHTNESS));
+  }
+  adjust_add(&adjust_brightness, a->i);
+}
+
+void mpd_action(const Arg *a){
+  const char **cmd = (const char **) a->v;
+
+  //Expected state. Track changes can't be predicted, the title follows when mpc finishes
+  pthread_mutex_lock(&mutex_mpc);
+  if (cmd == mpc_toggle && mpd_status != MPDStopped){
+    mpd_status = mpd_status == MPDPlaying ? MPDPaused : MPDPlaying;
+  } else if (cmd == mpc_stop){
+    mpd_status = MPDStopped;
+  }
+  mpd_actions_pending++;
+  pthread_mutex_unlock(&mutex_mpc);
+
+  request_drawbars_modules(bar_modules_mask(BAR_MODULE_MPC));
+  if (spawn_async(cmd, NULL, false, mpd_exited, NULL) == NULL){
+    mpd_reconcile();
+  }
 }
 
 void notify_send(const char *title, const char *text){
@@ -103,6 +564,21 @@ int percentage_to_progressbar(char *buffer, int percentage, int len){
   return 0;
 }
 
+static void screenshot_taken(int status, const char *output, void *data){
+  if (status == 0){
+    notify_send("Screenshot taken!", (char *) data);
+  }
+  free(data);
+}
+
+static void screenshot_start(const char **cmd, const char *name){
+  char *n = strdup(name);
+
+  if (n != NULL && spawn_async(cmd, NULL, false, screenshot_taken, n) == NULL){
+    free(n);
+  }
+}
+
 void scripts_take_screenshot(const Arg *a){
   DIR *d;
   struct dirent *dir;
@@ -112,9 +588,6 @@ void scripts_take_screenshot(const Arg *a){
   time_t rawtime;
   struct tm *timeinfo;
 
-  int scrot_pid;
-  int scrot_status = -1;
-
   char *month = "";
   char bufname[128];
   char bufpath[256];
@@ -160,38 +633,71 @@ void scripts_take_screenshot(const Arg *a){
   snprintf(bufpath, 255, "%s/%s", SCREENSHOT_DIR, bufname);
 
 
-  pthread_mutex_lock(&mutex_drawbar);
+  //scrot -s waits for the user to select an area. The WM goes on meanwhile
   if (a->i == 0){
     const char *cmd[] = {"scrot", bufpath, NULL};
-    Arg arg;
-    arg.v = cmd;
-    scrot_pid = spawn_pid(&arg);
-
-    waitpid(scrot_pid, &scrot_status, 0);
+    screenshot_start(cmd, bufname);
   } else if (a->i == 1){
     const char *cmd[] = {"scrot", "-s", bufpath, NULL};
-    Arg arg;
-    arg.v = cmd;
-    scrot_pid = spawn_pid(&arg);
-
-    waitpid(scrot_pid, &scrot_status, 0);
-  } else {
-    return;
+    screenshot_start(cmd, bufname);
   }
-  pthread_mutex_unlock(&mutex_drawbar);
+}
 
-  if (scrot_status == 0){
-    notify_send("Screenshot taken!", bufname);
+//DISPLAY
+static void monitor_turned_off(int status, const char *output, void *data){
+  display_state_check();
+}
+
+void monitor_off(const Arg *a){
+  if (spawn_async(monitoroffcmd, NULL, false, monitor_turned_off, NULL) == NULL){
+    display_state_poll_soon();
   }
+}
 
+void lock_screen(const Arg *a){
+  Arg arg = {.v = lockscreencmd};
+  display_state_set_locker(spawn_pid(&arg));
 }
 
 //UPDATES CHECKER
-void  *check_updates(void *args){
+//Official repo updates straight from the databases checkupdates keeps. Only rescans when they changed on disk:
+//after checkupdates refreshed them, or pacman changed the installed packages
+int check_updates_native(void){
+  int updates_pacman_local = pacman_db_count_updates(pacman_db_path());
+
+  if (updates_pacman_local < 0){
+    return -1;
+  }
+
   pthread_mutex_lock(&mutex_fetchupdates);
+  if (n_updates_pacman != updates_pacman_local){
+    n_updates_pacman = updates_pacman_local;
+    request_drawbars_modules(bar_modules_mask(BAR_MODULE_UPDATES));
+  }
+  pthread_mutex_unlock(&mutex_fetchupdates);
+
+  return updates_pacman_local;
+}
+
+//Only one check runs at a time, asking again meanwhile does nothing
+static bool check_updates_begin(void){
+  bool started;
+
+  pthread_mutex_lock(&mutex_fetchupdates);
+  started = !checking_updates;
   checking_updates = true;
   pthread_mutex_unlock(&mutex_fetchupdates);
 
+  return started;
+}
+
+void  *check_updates(void *args){
+  spawn_stats_set_tag("updates");
+  if (!check_updates_begin()){
+    return NULL;
+  }
+  request_drawbars_modules(bar_modules_mask(BAR_MODULE_UPDATES));
+
   const char *checkupdates[] = {"checkupdates", NULL};
   Arg checkupdates_arg = {.v = checkupdates};
 
@@ -199,10 +705,15 @@ void  *check_updates(void *args){
   Arg checkupdates_aur_arg = {.v = checkupdates_aur};
 
   int updates_pacman_local;
+  int updates_native;
   int updates_aur_local;
 
-  //Get pacman updates
+  //Get pacman updates. checkupdates refreshes its copy of the sync databases, which is then read natively.
+  //Its own output only counts if that copy can't be read
   updates_pacman_local = spawn_countlines(&checkupdates_arg);
+  if ((updates_native = pacman_db_count_updates(pacman_db_path())) >= 0){
+    updates_pacman_local = updates_native;
+  }
   updates_aur_local    = spawn_countlines(&checkupdates_aur_arg);
 
   //Modify the global updates variable in mutex
@@ -212,11 +723,22 @@ void  *check_updates(void *args){
   checking_updates = false;
   pthread_mutex_unlock(&mutex_fetchupdates);
 
+  request_drawbars_modules(bar_modules_mask(BAR_MODULE_UPDATES));
+
   return NULL;
 }
 void async_check_updates_handler(const Arg *a){
   pthread_t tid;
-  pthread_create(&tid, NULL, check_updates, NULL);
+  bool running;
+
+  pthread_mutex_lock(&mutex_fetchupdates);
+  running = checking_updates;
+  pthread_mutex_unlock(&mutex_fetchupdates);
+
+  //check_updates() itself makes sure only one runs, this spares the thread
+  if (!running && pthread_create(&tid, NULL, check_updates, NULL) == 0){
+    pthread_detach(tid);
+  }
 }
 void toggle_update_checks(const Arg *a){
   if (shall_fetch_updates){
@@ -37,6 +37,7 @@
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
 #include <X11/Xlib-xcb.h>
+#include <X11/XKBlib.h>
 #include <xcb/res.h>
 #include <pthread.h>
 #ifdef XINERAMA
@@ -53,6 +54,20 @@
 #include <spawn_programs.h>
 #include <bar_modules.h>
 #include <global_vars.h>
+#include <event_loop.h>
+#include <sysfs.h>
+#include <proc_stats.h>
+#include <bar_scheduler.h>
+#include <display_state.h>
+#include <power_policy.h>
+#include <backlight.h>
+#include <zygote.h>
+#include <children.h>
+#include <spawn_stats.h>
+#include <line_filter.h>
+#include <command_cache.h>
+#include <power_supply.h>
+#include <pulse_volume.h>
 
 #include "drw.h"
 #include "util.h"
@@ -143,6 +158,10 @@ struct Monitor {
 	Monitor *next;
 	Window barwin;
 	const Layout *lt[2];
+  Pixmap barpix;                            //Last painted bar. Unchanged modules are kept from here
+  int barpix_w;
+  unsigned int barlayout;                   //bar_layout_serial the modules were painted with
+  unsigned int barserial[BAR_MAX_MODULES];  //Output serial of each painted module
 };
 
 typedef struct {
@@ -176,9 +195,13 @@ static void destroynotify(XEvent *e);
 static void detach(Client *c);
 static void detachstack(Client *c);
 static Monitor *dirtomon(int dir);
+static int barvisible(Monitor *m);
 static void drawbar(Monitor *m);
+static void updatebarvisibility(void);
+static void drawbarmodule(Monitor *m, int i);
+static void bar_modules_update(unsigned int modules);
+static void drawbarsmodules(unsigned int modules);
 static void drawbars(void);
-static void drawbars_caller_with_arg(const Arg *a);
 static void enternotify(XEvent *e);
 static void expose(XEvent *e);
 static void focus(Client *c);
@@ -224,7 +247,6 @@ static void togglegaps (const Arg *arg);
 static void setup(void);
 static void seturgent(Client *c, int urg);
 static void showhide(Client *c);
-static void sigchld(int unused);
 // static void spawn(const Arg *arg);
 static void tag(const Arg *arg);
 static void tagmon(const Arg *arg);
@@ -247,6 +269,7 @@ static void updatetitle(Client *c);
 static void updatewindowtype(Client *c);
 static void updatewmhints(Client *c);
 static void view(const Arg *arg);
+static void xkbevent(XEvent *e);
 static Client *wintoclient(Window w);
 static Monitor *wintomon(Window w);
 static int xerror(Display *dpy, XErrorEvent *ee);
@@ -285,6 +308,7 @@ int mpd_status = MPDStopped;            //Extern defined on <global_vars.h>
 char mpd_song[128];                     //Extern defined on <global_vars.h>
 char mpd_songduration[64];              //Extern defined on <global_vars.h>
 char mpd_percentage[8];                 //Extern defined on <global_vars.h>
+int mpd_actions_pending = 0;            //Extern defined on <global_vars.h>
 
 bool shall_fetch_updates = true;
 bool checking_updates = false;
@@ -318,6 +342,8 @@ static void (*handler[LASTEvent]) (XEvent *) = {
 	[PropertyNotify] = propertynotify,
 	[UnmapNotify] = unmapnotify
 };
+static int xkbeventtype = -1;        /* XKB extension events are not covered by handler[] */
+static int screensavereventtype = -1; /* MIT-SCREEN-SAVER ScreenSaverNotify */
 static Atom wmatom[WMLast], netatom[NetLast];
 static int running = 1;
 static Cur *cursor[CurLast];
@@ -338,7 +364,8 @@ static int window_gap_inner;
 static int window_gap_outter;
 
 static pthread_t mpc_loop_pthread_t;
-static pthread_t bar_loop_pthread_t;
+static unsigned int bar_layout_serial = 0;   //Incremented when any module moves or changes width
+static int bar_modules_textwidth = 0;
 static pthread_t updates_checker_pthread_t;
 static pthread_t connection_checker_pthread_t;
 
@@ -471,6 +498,7 @@ arrange(Monitor *m)
 		restack(m);
 	} else for (m = mons; m; m = m->next)
 		arrangemon(m);
+	updatebarvisibility();
 }
 
 void
@@ -539,13 +567,35 @@ void unswallow(Client *c){
   arrange(c->mon);
 }
 
+//Removes the queued clicks (and their releases) of the same button behind ev. Returns how many.
+//A spinning mouse wheel queues many of them
+static int
+dropbuttonrepeats(XButtonPressedEvent *ev)
+{
+	XEvent next;
+	int n = 0;
+
+	while (XEventsQueued(dpy, QueuedAfterReading) > 0) {
+		XPeekEvent(dpy, &next);
+		if ((next.type != ButtonPress && next.type != ButtonRelease)
+		|| next.xbutton.button != ev->button || next.xbutton.window != ev->window)
+			break;
+		XNextEvent(dpy, &next);
+		if (next.type == ButtonPress)
+			n++;
+	}
+	return n;
+}
+
 void
 buttonpress(XEvent *e)
 {
 	unsigned int i, j, tags_width, click, is_tag_selected, occ = 0;
   unsigned int modules_fullwidth = 0, nummodules;
   int modules_width_progress = 0;  //Used when detecting which module was pressed
+  int repeats;
   BarModule module;  //Bar module
+  const char *stats_tag;
 	Arg arg = {0};
 	Client *c;
 	Monitor *m;
@@ -610,8 +660,12 @@ buttonpress(XEvent *e)
           module = bar_modules[j];
           //Call function with specified click and mask
           if (module.functionOnClick){
-            module.functionOnClick(CLEANMASK(ev->state), ev->button); //Call the function
-            drawbars();
+            //Wheel scrolls: the clicks that queued up meanwhile are handed over with this one, as a single step
+            repeats = ev->button == Button4 || ev->button == Button5 ? dropbuttonrepeats(ev) : 0;
+            stats_tag = spawn_stats_set_tag(bar_module_name(module.id));
+            module.functionOnClick(CLEANMASK(ev->state), ev->button, 1 + repeats); //Call the function
+            spawn_stats_set_tag(stats_tag);
+            request_drawbars_modules(1u << j);
           }
           return;
         }
@@ -634,10 +688,12 @@ buttonpress(XEvent *e)
 	}
 
   buttonpress_findbutton:
+  stats_tag = spawn_stats_set_tag("buttons");
 	for (i = 0; i < LENGTH(buttons); i++)
 		if (click == buttons[i].click && buttons[i].func && buttons[i].button == ev->button
 		&& CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state))
 			buttons[i].func(click == ClkTagBar && buttons[i].arg.i == 0 ? &arg : &buttons[i].arg);
+  spawn_stats_set_tag(stats_tag);
 }
 
 void
@@ -692,6 +748,8 @@ cleanupmon(Monitor *mon)
 	}
 	XUnmapWindow(dpy, mon->barwin);
 	XDestroyWindow(dpy, mon->barwin);
+	if (mon->barpix != None)
+		XFreePixmap(dpy, mon->barpix);
 	free(mon);
 }
 
@@ -881,99 +939,202 @@ dirtomon(int dir)
 	return m;
 }
 
-void
-drawbar(Monitor *m)
-{
-	int x, w, modules_textwidth = 0;
-  int is_tag_selected;
-  int nmons = 0;
-	unsigned int i, occ = 0, urg = 0;
-	Client *c;
-
-  //Quit if we should not draw the bar
-	if (!m->showbar)
-		return;
-
-  //Drawing the bar is protected by mutex
-  pthread_mutex_lock(&mutex_drawbar);
-
-  //Draw empty bar canvas
-  drw_rect(drw, 0, 0, m->ww, bh, 1, 1);
-
-  // ----------- Draw modules -------------
-  int module_width;             //Width in pixels of current module (set inside loop)
+//Runs the modules in the mask and caches their output. Text is only shaped again when it changed,
+//and the layout serial only moves when a module width did
+void bar_modules_update(unsigned int modules){
   int side_padding = 7;         //Pixel padding left and right to each module. Gets "doubled" because each module has its own.
-  char buffer[256] = "";        //Text returned by module to be written in bar
-  char module_barcolor[8];      //Color returned by module to be set as extra color accent if bar_hibar or bar_lobar are bigger than 0.
-  const char *module_scheme[3]; //Array of 3 color strings. In reality, will be set to {module_barcolor, module_barcolor, module_barcolor} to just draw line with said color.
-  const unsigned int module_alphas[3] = {0xff, 0xff, 0xff};
-  Clr *scheme_color;            //Color scheme structure, set with drw_scm_create and passed to drw_setscheme.
+  int module_width, right = 0;
+  bool layout_changed = false;
+  BarModuleOutput *out;
+  char buffer[BAR_MODULE_TEXTLEN];
+  char module_barcolor[8];
+  const char *stats_tag;
+  int i;
+
+  for (i = 0; bar_modules[i].function != NULL; i++){
+    out = &bar_modules_output[i];
 
-  //i loops through all modules. module is the module being currently drawn
-  i = 0;
-  BarModule module = bar_modules[i];
-  do {
     //Empty the buffers to check if functions return something through them
-    buffer[0] = '\0';           //Text to be written in the module
-    module_barcolor[0] = '\0';  //Color of the bottom / top bar of the module
+    buffer[0] = '\0';
+    module_barcolor[0] = '\0';
+    if (out->serial != 0 && !(modules & 1u << i)){
+      strcpy(buffer, out->text);
+      strcpy(module_barcolor, out->color);
+    } else {
+      stats_tag = spawn_stats_set_tag(bar_module_name(bar_modules[i].id));
+      bar_modules[i].function(BAR_MODULE_TEXTLEN, buffer, NULL, module_barcolor);
+      spawn_stats_set_tag(stats_tag);
+    }
 
-    //Set scheme
-    drw_setscheme(drw, scheme[SchemeNorm]);
-    module.function(256, buffer, NULL, module_barcolor);
+    if (out->serial == 0 || strcmp(buffer, out->text) != 0 || strcmp(module_barcolor, out->color) != 0){
+      if (out->serial == 0 || strcmp(buffer, out->text) != 0){
+        out->textw = TEXTW(buffer) - lrpad;
+      }
+      strcpy(out->text, buffer);
+      strcpy(out->color, module_barcolor);
+      out->serial++;
+    }
 
     //Padding only if ID's don't match (If they match, its the same module)
     if (i != 0 && bar_modules[i].id != bar_modules[i-1].id){
-      module_width = TEXTW(buffer) - lrpad + side_padding;
+      module_width = out->textw + side_padding;
     } else {
-      module_width = TEXTW(buffer) - lrpad;
+      module_width = out->textw;
     }
 
-    drw_text(drw, m->ww - (module_width + modules_textwidth), bar_hibar, module_width, bh - (bar_lobar + bar_hibar), 0, buffer, 0); //Draw module text
-
-    if (module_barcolor[0] != '\0'){
-      module_scheme[0] = module_barcolor; // Color scheme internally uses 3 colors, but
-      module_scheme[1] = module_barcolor; // we only want to draw one, so we set all 3
-      module_scheme[2] = module_barcolor; // to be the same color.
-
-		  scheme_color = drw_scm_create(drw, (const char **) module_scheme, module_alphas, 3);
-      drw_setscheme(drw, scheme_color);
-
-      if (i != 0 && bar_modules[i].id != bar_modules[i-1].id){
-        drw_rect(drw, m->ww - (module_width + modules_textwidth), 0,              module_width - side_padding, bar_hibar, 1, 1);
-        drw_rect(drw, m->ww - (module_width + modules_textwidth), bh - bar_lobar, module_width - side_padding, bar_lobar, 1, 1);
-      } else {
-        drw_rect(drw, m->ww - (module_width + modules_textwidth), 0,              module_width,                bar_hibar, 1, 1);
-        drw_rect(drw, m->ww - (module_width + modules_textwidth), bh - bar_lobar, module_width,                bar_lobar, 1, 1);
-      }
-
-      free(scheme_color);
-      drw_setscheme(drw, scheme[SchemeNorm]);
+    if (out->right != right || out->drawwidth != module_width){
+      layout_changed = true;
     }
+    out->right = right;
+    out->drawwidth = module_width;
+    out->separator = false;
 
     //Offset next drawing position to the left
-    if (strcmp(buffer, "") != 0){
-
+    if (out->text[0] != '\0'){
       //Different ID = different modules
       if (bar_modules[i].id != bar_modules[i+1].id){
-        module.width = module_width + side_padding; //3px padding on the left
-        bar_modules[i].width = module_width + side_padding;
-        modules_textwidth += module.width;
+        bar_modules[i].width = module_width + side_padding; //3px padding on the left
+        right += bar_modules[i].width;
 
-        //Draw vertical separators between modules
+        //Vertical separators between modules
         if (bar_modules[i+1].function != NULL){
-          drw_rect(drw, m->ww - (modules_textwidth + bar_separatorwidth), 0, bar_separatorwidth, bh, 1, 0);
-          modules_textwidth += bar_separatorwidth;
+          out->separator = true;
+          right += bar_separatorwidth;
         }
       } else { //Same ID = Same module but separated with different functions
-        module.width = module_width; //No padding
-        bar_modules[i].width = module_width;
-        modules_textwidth += module.width;
+        bar_modules[i].width = module_width; //No padding
+        right += module_width;
       }
     }
+  }
 
-    i++;
-    module = bar_modules[i];
-  } while (module.function != NULL);
+  if (layout_changed || right != bar_modules_textwidth || bar_layout_serial == 0){
+    bar_modules_textwidth = right;
+    bar_layout_serial++;
+  }
+}
+
+//Paints module i from its cached output, over its own area only
+void drawbarmodule(Monitor *m, int i){
+  int side_padding = 7;
+  BarModuleOutput *out = &bar_modules_output[i];
+  int x = m->ww - (out->drawwidth + out->right);
+  const char *module_scheme[3]; //Array of 3 color strings. In reality, will be set to {module_barcolor, module_barcolor, module_barcolor} to just draw line with said color.
+  const unsigned int module_alphas[3] = {0xff, 0xff, 0xff};
+  Clr *scheme_color;            //Color scheme structure, set with drw_scm_create and passed to drw_setscheme.
+  int barwidth;
+
+  if (out->text[0] == '\0'){
+    return;
+  }
+
+  drw_setscheme(drw, scheme[SchemeNorm]);
+  drw_rect(drw, x, 0, out->drawwidth, bh, 1, 1);
+  drw_text(drw, x, bar_hibar, out->drawwidth, bh - (bar_lobar + bar_hibar), 0, out->text, 0); //Draw module text
+
+  if (out->color[0] != '\0'){
+    module_scheme[0] = out->color; // Color scheme internally uses 3 colors, but
+    module_scheme[1] = out->color; // we only want to draw one, so we set all 3
+    module_scheme[2] = out->color; // to be the same color.
+
+    scheme_color = drw_scm_create(drw, (const char **) module_scheme, module_alphas, 3);
+    drw_setscheme(drw, scheme_color);
+
+    if (i != 0 && bar_modules[i].id != bar_modules[i-1].id){
+      barwidth = out->drawwidth - side_padding;
+    } else {
+      barwidth = out->drawwidth;
+    }
+    drw_rect(drw, x, 0,              barwidth, bar_hibar, 1, 1);
+    drw_rect(drw, x, bh - bar_lobar, barwidth, bar_lobar, 1, 1);
+
+    free(scheme_color);
+    drw_setscheme(drw, scheme[SchemeNorm]);
+  }
+
+  //Draw vertical separators between modules
+  if (out->separator){
+    drw_rect(drw, m->ww - (out->right + bar_modules[i].width + bar_separatorwidth), 0, bar_separatorwidth, bh, 1, 0);
+  }
+}
+
+//The bar is hidden with togglebar or covered by a fullscreen client
+int
+barvisible(Monitor *m)
+{
+	Client *c;
+
+	if (!m->showbar)
+		return 0;
+	for (c = m->clients; c; c = c->next)
+		if (c->isfullscreen && ISVISIBLE(c))
+			return 0;
+	return 1;
+}
+
+//When no monitor shows its bar, modules stop being evaluated and polling threads sleep
+void
+updatebarvisibility(void)
+{
+	Monitor *m;
+
+	for (m = mons; m && !barvisible(m); m = m->next);
+	display_state_set_bars_hidden(m == NULL);
+}
+
+void
+drawbar(Monitor *m)
+{
+	int x, w, modules_textwidth = 0;
+  int relayout;
+  Drawable drawable;
+  int is_tag_selected;
+  int nmons = 0;
+	unsigned int i, occ = 0, urg = 0;
+	Client *c;
+
+  //Quit if the bar can't be seen. Modules catch up when it shows again
+	if (!barvisible(m))
+		return;
+
+  //Drawing the bar is protected by mutex
+  pthread_mutex_lock(&mutex_drawbar);
+
+  if (bar_layout_serial == 0){
+    bar_modules_update(~0u);
+  }
+
+  //Each monitor keeps its own pixmap, so unchanged modules need no drawing at all
+  if (m->barpix == None || m->barpix_w != m->ww){
+    if (m->barpix != None)
+      XFreePixmap(dpy, m->barpix);
+    m->barpix = XCreatePixmap(dpy, root, m->ww, bh, drw->depth);
+    m->barpix_w = m->ww;
+    m->barlayout = 0;
+  }
+  drawable = drw->drawable;
+  drw->drawable = m->barpix;
+
+  // ----------- Draw modules -------------
+  modules_textwidth = bar_modules_textwidth;
+  relayout = m->barlayout != bar_layout_serial;
+  drw_setscheme(drw, scheme[SchemeNorm]);
+
+  //Module widths changed, everything moves. Clear the area and paint them all
+  if (relayout){
+    drw_rect(drw, m->ww - modules_textwidth, 0, modules_textwidth, bh, 1, 1);
+    m->barlayout = bar_layout_serial;
+  }
+
+  for (i = 0; bar_modules[i].function != NULL; i++){
+    if (!relayout && m->barserial[i] == bar_modules_output[i].serial){
+      bar_module_repaints_skipped++;
+      continue;
+    }
+    m->barserial[i] = bar_modules_output[i].serial;
+    bar_module_repaints++;
+    drawbarmodule(m, i);
+  }
 
 	///* draw status first so it can be overdrawn by tags later */
 	//if (m == selmon) { /* status is only drawn on selected monitor */
@@ -996,6 +1157,9 @@ drawbar(Monitor *m)
 
 
   // -------------- Draw tags (workspaces) ----------------
+  drw_setscheme(drw, scheme[SchemeNorm]);
+  drw_rect(drw, 0, 0, m->ww - modules_textwidth, bh, 1, 1);
+
   //Which tags have windows?
 	for (c = m->clients; c; c = c->next) {
 		occ |= c->tags;
@@ -1045,32 +1209,58 @@ drawbar(Monitor *m)
 
   // -------------- Draw bar on screen ---------------
 	drw_map(drw, m->barwin, 0, 0, m->ww, bh);
+  drw->drawable = drawable;
 
   pthread_mutex_unlock(&mutex_drawbar);
 }
 void
 drawbars(void)
+{
+	drawbarsmodules(~0u);
+}
+
+//Runs the modules in the mask (bar_modules[] index bits), then redraws every bar
+void
+drawbarsmodules(unsigned int modules)
 {
 	Monitor *m;
 
+	//Nobody would see the result. Everything is refreshed when a bar shows again
+	if (!display_awake())
+		return;
+
+	//Every sysfs attribute and /proc file the modules will need, read in a single batch
+	if (modules & (bar_modules_mask(BAR_MODULE_CPU) | bar_modules_mask(BAR_MODULE_MEMORY) | bar_modules_mask(BAR_MODULE_NETWORK)
+	| bar_modules_mask(BAR_MODULE_DISK) | bar_modules_mask(BAR_MODULE_TEMPERATURE)))
+		proc_stats_expire();
+	sysfs_attr_refresh();
+
+	//Modules run once for all monitors
+	pthread_mutex_lock(&mutex_drawbar);
+	bar_modules_update(modules);
+	pthread_mutex_unlock(&mutex_drawbar);
+
 	for (m = mons; m; m = m->next)
 		drawbar(m);
 }
-//This function is just an extra step so to not include the drawbars() function directly in the keys array
-void drawbars_caller_with_arg(const Arg *a){
-  drawbars();
-}
 
 void *updates_checker(void *args){
+  spawn_stats_set_tag("updates");
   //Wait a little for internet connection to be stablished
-  sleep(5);
+  display_sleep(5);
   while (1){
     if (shall_fetch_updates){
       check_updates(NULL);
     }
 
-    sleep(1);   //First sleep call getting ignored??? Bug with compiler maybe?
-    sleep(900); //Sleep 15 minutes
+    //checkupdates refreshes its databases in the full check, every 15 minutes with AUR.
+    //In between, they are only rescanned when they change, so pacman -Syu shows up closely
+    for (int i = 0; i < 15; i++){
+      display_sleep(60);
+      if (shall_fetch_updates){
+        check_updates_native();
+      }
+    }
   }
   return NULL;
 }
@@ -1084,10 +1274,12 @@ void *connection_checker(void *args){
   char *pattern_eth = "ethernet";
   char buffer[128];
   char *tok;
+  bool changed;
 
+  spawn_stats_set_tag("connection");
   for (;;){
     //Get ethernet status
-    spawn_greppattern(&arg_eth, NULL, pattern_eth, buffer, 127);
+    spawn_greppattern(&arg_eth, pattern_eth, buffer, 127);
     tok = strchr(buffer, '\n');
     if (tok != NULL){
       *tok = '\0';
@@ -1099,7 +1291,7 @@ void *connection_checker(void *args){
     }
 
     //Get wifi status
-    spawn_greppattern(&arg_wifi, NULL, pattern_wifi, buffer, 127);
+    spawn_greppattern(&arg_wifi, pattern_wifi, buffer, 127);
     if (strcmp(buffer, "") == 0 || strncmp(buffer, "yes:", 4) != 0){
       is_w_con = false;
     } else {
@@ -1111,67 +1303,58 @@ void *connection_checker(void *args){
     }
 
     pthread_mutex_lock(&mutex_connection_checker);
+    changed = is_ethernet_connected != is_e_con || is_wifi_connected != is_w_con || strcmp(wifi_ssid, buffer+4) != 0;
     is_ethernet_connected = is_e_con;
     is_wifi_connected = is_w_con;
     snprintf(wifi_ssid, 127, buffer+4);
     pthread_mutex_unlock(&mutex_connection_checker);
 
-    sleep(1);
-    sleep(5);
+    //Connection modules have no period, they are only refreshed on change
+    if (changed){
+      request_drawbars_modules(bar_modules_mask(BAR_MODULE_WIRED) | bar_modules_mask(BAR_MODULE_WIRELESS));
+    }
+
+    display_sleep(6);
   }
 }
 
+//One "mpc status", parsed here:
+//  Artist - Title
+//  [playing] #3/12   1:02/3:45 (27%)
+//  volume: 80%   repeat: off   random: off   single: off   consume: off
+//Only the volume line when stopped
+#define MPC_STATUS_TTL_MS 500      //The MPD checker and actions finishing share the same run
+#define MPC_STATUS_PATTERN "^(.*)\n\\[(playing|paused)\\] +#[0-9]+/[0-9]+ +(([0-9]+:)*[0-9]+/([0-9]+:)*[0-9]+) +\\(([0-9]+)%\\)"
+
 void setmpcstatus(const Arg *arg_unused){
-  char buffer[64];
+  char output[512];
+  char state[8];
   char durbuffer[64];
   char songbuffer[128];
   char percbuffer[8];
-  char *tok;
-  Arg arg;
-
-  const char *mpc_statuscmd[] = {"mpc", "status", NULL};
-  const char *mpc_currentcmd[] = {"mpc", "current", NULL};
 
   int status_local = MPDStopped;
+  bool changed;
 
 
-  arg.v = mpc_statuscmd;
-
-  buffer[0] = '\0';
-  spawn_greppattern(&arg, NULL, "^\\[playing\\].*#[0-9]*/[0-9]*.*([0-9]*%)", buffer, sizeof(buffer)-1);
-  if (strlen(buffer) > 0){
-    status_local = MPDPlaying;
-  } else {
-    buffer[0] = '\0';
-    spawn_greppattern(&arg, NULL, "^\\[paused\\].*#[0-9]*/[0-9]*.*([0-9]*%)", buffer, sizeof(buffer)-1);
-    if (strlen(buffer) > 0){
-      status_local = MPDPaused;
-    }
+  output[0] = '\0';
+  command_cache_output(mpc_status, MPC_STATUS_TTL_MS, output, sizeof(output));
+  if (line_filter_extract(output, MPC_STATUS_PATTERN, REG_EXTENDED | REG_NEWLINE, 2, state, sizeof(state))){
+    status_local = strcmp(state, "playing") == 0 ? MPDPlaying : MPDPaused;
   }
 
-  if (status_local == MPDPlaying || MPDPaused){
-    durbuffer[0] = '\0';
-    spawn_greppattern(&arg, "-Po", "(?<= )(?<!#)([0-9]+:)*[0-9]+/([0-9]+:)*[0-9]+ ", durbuffer, sizeof(durbuffer)-1);
-    if ((tok = strchr(durbuffer, '\n'))){
-      *tok = '\0';
-    }
-    if ((tok = strchr(durbuffer, ' '))){
-      *tok = '\0';
-    }
-
-    percbuffer[0] = '\0';
-    spawn_greppattern(&arg, "-Po", "(?<=\\()[0-9]+(?=%\\))", percbuffer, sizeof(durbuffer)-1);
-    if ((tok = strchr(percbuffer, '\n'))){
-      *tok = '\0';
-    }
-
-    arg.v = mpc_currentcmd;
-    spawn_catchoutput(&arg, songbuffer, sizeof(songbuffer)-1);
-    if ((tok = strchr(songbuffer, '\n'))){
-      *tok = '\0';
-    }
+  if (status_local != MPDStopped){
+    line_filter_extract(output, MPC_STATUS_PATTERN, REG_EXTENDED | REG_NEWLINE, 1, songbuffer, sizeof(songbuffer));
+    line_filter_extract(output, MPC_STATUS_PATTERN, REG_EXTENDED | REG_NEWLINE, 3, durbuffer, sizeof(durbuffer));
+    line_filter_extract(output, MPC_STATUS_PATTERN, REG_EXTENDED | REG_NEWLINE, 6, percbuffer, sizeof(percbuffer));
 
     pthread_mutex_lock(&mutex_mpc);
+    //An action is still running, this status may predate it. Keep its expected state
+    if (mpd_actions_pending > 0){
+      pthread_mutex_unlock(&mutex_mpc);
+      return;
+    }
+    changed = mpd_status != status_local || strcmp(mpd_song, songbuffer) != 0 || strcmp(mpd_songduration, durbuffer) != 0 || strcmp(mpd_percentage, percbuffer) != 0;
     mpd_status = status_local;
     strcpy(mpd_song, songbuffer);
     strcpy(mpd_songduration, durbuffer);
@@ -1179,33 +1362,30 @@ void setmpcstatus(const Arg *arg_unused){
     pthread_mutex_unlock(&mutex_mpc);
   } else {
     pthread_mutex_lock(&mutex_mpc);
+    if (mpd_actions_pending > 0){
+      pthread_mutex_unlock(&mutex_mpc);
+      return;
+    }
+    changed = mpd_status != status_local;
     mpd_status = status_local;
     mpd_song[0] = '\0';
     mpd_songduration[0] = '\0';
     mpd_percentage[0] = '\0';
     pthread_mutex_unlock(&mutex_mpc);
   }
+
+  //MPD modules have no period, they are only refreshed on change
+  if (changed){
+    request_drawbars_modules(bar_modules_mask(BAR_MODULE_MPC));
+  }
 }
 
 void *mpc_loop(void *args){
+  spawn_stats_set_tag("mpd");
   for (;;){
     setmpcstatus(NULL);
 
-    sleep(1);
-    sleep(1);
-  }
-  return NULL;
-}
-
-void *bar_loop(void *args){
-  int sleeptime = *((int *) args);
-  if (sleeptime <= 0){
-    return NULL;
-  }
-  for (;;){
-    sleep(1);
-    sleep(sleeptime);
-    drawbars();
+    display_sleep(2);
   }
   return NULL;
 }
@@ -1439,12 +1619,33 @@ isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
 }
 #endif /* XINERAMA */
 
+//Removes the auto-repeats of ev already queued right behind it. Returns how many.
+//With detectable auto-repeat, a held key is a run of KeyPress events without KeyRelease
+static int
+dropkeyrepeats(XKeyEvent *ev)
+{
+	XEvent next;
+	int n = 0;
+
+	while (XEventsQueued(dpy, QueuedAfterReading) > 0) {
+		XPeekEvent(dpy, &next);
+		if (next.type != KeyPress || next.xkey.keycode != ev->keycode || next.xkey.state != ev->state)
+			break;
+		XNextEvent(dpy, &next);
+		n++;
+	}
+	return n;
+}
+
 void
 keypress(XEvent *e)
 {
 	unsigned int i;
 	KeySym keysym;
 	XKeyEvent *ev;
+	Arg arg;
+	int repeats = -1;
+  const char *stats_tag = spawn_stats_set_tag("keys");
 
 	ev = &e->xkey;
 	keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
@@ -1452,9 +1653,16 @@ keypress(XEvent *e)
 		if (keysym == keys[i].keysym
 		&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
 		&& keys[i].func) {
-			keys[i].func(&(keys[i].arg));
+      //Held volume and brightness keys: the repeats that queued up become a single bigger step
+      if (keys[i].func == change_volume || keys[i].func == change_brightness) {
+        if (repeats < 0)
+          repeats = dropkeyrepeats(ev);
+        arg.i = keys[i].arg.i * (1 + repeats);
+        keys[i].func(&arg);
+      } else
+        keys[i].func(&(keys[i].arg));
     }
-
+  spawn_stats_set_tag(stats_tag);
 }
 
 void
@@ -2160,14 +2368,29 @@ restack(Monitor *m)
 void
 run(void)
 {
+	unsigned int due;
 	XEvent ev;
 	/* main event loop */
 	XSync(dpy, False);
-	while (running && !XNextEvent(dpy, &ev)) {
-		if (handler[ev.type]) {
-			handler[ev.type](&ev); /* call handler */
-    }
-  }
+	while (running) {
+		while (running && XPending(dpy)) {
+			XNextEvent(dpy, &ev);
+			if (ev.type == xkbeventtype)
+				xkbevent(&ev);
+			else if (ev.type == screensavereventtype)
+				display_state_event(&ev);
+			else if (handler[ev.type])
+				handler[ev.type](&ev); /* call handler */
+		}
+		if (!running)
+			break;
+
+		//Sleep until X, a watched fd (uevents, ...) or another thread wakes us up
+		event_loop_wait(ConnectionNumber(dpy));
+		//Nobody sees the bar while blanked. The wake up requests a full refresh
+		if ((due = event_loop_redraw_pending()) && display_awake())
+			drawbarsmodules(due);
+	}
 }
 
 void
@@ -2272,6 +2495,7 @@ setfullscreen(Client *c, int fullscreen)
 		c->isfloating = 1;
 		resizeclient(c, c->mon->mx, c->mon->my, c->mon->mw, c->mon->mh);
 		XRaiseWindow(dpy, c->win);
+		updatebarvisibility();
 	} else if (!fullscreen && c->isfullscreen){
 		XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
 			PropModeReplace, (unsigned char*)0, 0);
@@ -2362,27 +2586,69 @@ setup(void)
 	XSetWindowAttributes wa;
 	Atom utf8string;
 
-	/* clean up any zombies immediately */
-	sigchld(0);
+  //Forked now, while the WM is small and has no threads. It starts every program from here on
+  if (zygote_start() < 0){
+    fprintf(stderr, "horizonwm: no launcher process, programs are started by the WM itself\n");
+  }
+
+  //Programs fed through a pipe may exit before reading it all: write() fails with EPIPE instead
+  signal(SIGPIPE, SIG_IGN);
+
+  //Children are reaped from the main loop (signalfd), and handed to whoever waits for them
+  children_init();
+  //What they cost, per bar module and action. kill -USR1 writes it out
+  spawn_stats_init();
 
-  //Keyboard mapping
+  //Keyboard mappings, all loaded as XKB groups. Active group is tracked through XkbStateNotify.
+  //setxkbmap is waited for, so the state read below is the one of the new keymap
   keyboard_mapping = 0;
-  { Arg arg;
-    arg.v = keyboard_mappings[keyboard_mapping];
-    scripts_set_keyboard_mapping(&arg);
+  scripts_load_keyboard_mappings();
+  { int major = XkbMajorVersion, minor = XkbMinorVersion;
+    XkbStateRec state;
+    if (XkbQueryExtension(dpy, NULL, &xkbeventtype, NULL, &major, &minor)) {
+      XkbSelectEventDetails(dpy, XkbUseCoreKbd, XkbStateNotify, XkbGroupLockMask, XkbGroupLockMask);
+      if (XkbGetState(dpy, XkbUseCoreKbd, &state) == Success)
+        keyboard_mapping = state.locked_group;
+    } else {
+      xkbeventtype = -1;
+    }
   }
 
+  //Held keys send KeyPress repeats without KeyRelease in between, so they can be merged
+  XkbSetDetectableAutoRepeat(dpy, True, NULL);
+
   //Init mutex
   pthread_mutex_init(&mutex_mpc, NULL);
   pthread_mutex_init(&mutex_drawbar, NULL);
   pthread_mutex_init(&mutex_fetchupdates, NULL);
   pthread_mutex_init(&mutex_connection_checker, NULL);
 
+  //Batteries, AC adapters and backlights
+  power_supply_discover(sysfs_root());
+
+  //Main loop wake up pipe. Before the PulseAudio thread, which may request a redraw right away
+  event_loop_init();
+
+  //Volume. Falls back to pamixer if PulseAudio isn't available
+  pulse_volume_init();
+
+  //Main loop fds. Power supply and backlight changes refresh the bar through uevents
+  { int fd;
+    if ((fd = sysfs_uevent_open()) >= 0)
+      event_loop_watch(fd, POLLIN, sysfs_uevent_handler, NULL);
+  }
+  //Refresh intervals depend on AC power and the platform profile
+  power_policy_init();
+  //Brightness keys write the backlight directly
+  backlight_control_init();
+  bar_scheduler_init();
+
 	/* init screen */
 	screen = DefaultScreen(dpy);
 	sw = DisplayWidth(dpy, screen);
 	sh = DisplayHeight(dpy, screen);
 	root = RootWindow(dpy, screen);
+  screensavereventtype = display_state_init(dpy, root);
   xinitvisual();
 	drw = drw_create(dpy, screen, root, sw, sh, visual, depth, cmap);
 	if (!drw_fontset_create(drw, fonts, LENGTH(fonts)))
@@ -2421,7 +2687,6 @@ setup(void)
 	updatebars();
 	updatestatus();
   pthread_create(&mpc_loop_pthread_t, NULL, mpc_loop, NULL);
-  pthread_create(&bar_loop_pthread_t, NULL, bar_loop, (void *) &bar_sleeptime);
   pthread_create(&updates_checker_pthread_t, NULL, updates_checker, NULL);
   pthread_create(&connection_checker_pthread_t, NULL, connection_checker, NULL);
 	/* supporting window for NetWMCheck */
@@ -2478,14 +2743,6 @@ showhide(Client *c)
 	}
 }
 
-void
-sigchld(int unused)
-{
-	if (signal(SIGCHLD, sigchld) == SIG_ERR)
-		die("can't install SIGCHLD handler:");
-	while (0 < waitpid(-1, NULL, WNOHANG));
-}
-
 void
 tag(const Arg *arg)
 {
@@ -3130,6 +3387,18 @@ wintomon(Window w)
 	return selmon;
 }
 
+void
+xkbevent(XEvent *e)
+{
+	XkbEvent *ev = (XkbEvent *)e;
+
+	/* layout may have been switched by us or by any other client */
+	if (ev->any.xkb_type == XkbStateNotify && ev->state.locked_group != keyboard_mapping) {
+		keyboard_mapping = ev->state.locked_group;
+		drawbarsmodules(bar_modules_mask(BAR_MODULE_KEYBOARDMAPPING));
+	}
+}
+
 /* There's no way to check accesses to destroyed windows, thus those cases are
  * ignored (especially on UnmapNotify's). Other types of errors call Xlibs
  * default error handler, which may call exit. */
@@ -0,0 +1,132 @@
+#include <line_filter.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct CachedRegex {
+  const char *pattern;                    //Callers pass literals, kept as is
+  int cflags;
+  bool ok;
+  regex_t re;
+} CachedRegex;
+
+static CachedRegex cache[LINE_FILTER_MAX_PATTERNS];
+static int ncached = 0;
+static pthread_mutex_t mutex_line_filter = PTHREAD_MUTEX_INITIALIZER;
+
+const regex_t *line_filter_regex(const char *pattern, int cflags){
+  const regex_t *re = NULL;
+  CachedRegex *c;
+
+  pthread_mutex_lock(&mutex_line_filter);
+  for (int i = 0; i < ncached; i++){
+    if (cache[i].cflags == cflags && strcmp(cache[i].pattern, pattern) == 0){
+      re = cache[i].ok ? &cache[i].re : NULL;
+      pthread_mutex_unlock(&mutex_line_filter);
+      return re;
+    }
+  }
+
+  if (ncached < LINE_FILTER_MAX_PATTERNS){
+    c = &cache[ncached++];
+    c->pattern = pattern;
+    c->cflags = cflags;
+    c->ok = regcomp(&c->re, pattern, cflags) == 0;
+    if (c->ok){
+      re = &c->re;
+    } else {
+      fprintf(stderr, "horizonwm: bad pattern '%s'\n", pattern);
+    }
+  } else {
+    fprintf(stderr, "horizonwm: too many patterns, '%s' ignored\n", pattern);
+  }
+  pthread_mutex_unlock(&mutex_line_filter);
+
+  return re;
+}
+
+void line_filter_init(LineFilter *f, const char *pattern, int cflags, char *out, size_t size){
+  memset(f, 0, sizeof(*f));
+  f->re = pattern != NULL ? line_filter_regex(pattern, cflags) : NULL;
+  f->out = out;
+  f->size = size;
+  if (out != NULL && size > 0){
+    out[0] = '\0';
+  }
+}
+
+static void line_filter_line(LineFilter *f){
+  size_t n;
+
+  f->line[f->len] = '\0';
+  if (f->re != NULL && regexec(f->re, f->line, 0, NULL, 0) == 0){
+    f->matches++;
+    //Like grep: the whole line and its newline, as much as fits
+    if (f->out != NULL && f->used + 1 < f->size){
+      n = f->len < f->size - f->used - 1 ? f->len : f->size - f->used - 1;
+      memcpy(f->out + f->used, f->line, n);
+      f->used += n;
+      if (f->used + 1 < f->size){
+        f->out[f->used++] = '\n';
+      }
+      f->out[f->used] = '\0';
+    }
+  }
+  f->len = 0;
+  f->cut = false;
+}
+
+void line_filter_feed(LineFilter *f, const char *data, size_t n){
+  const char *end = data + n;
+  const char *nl;
+  size_t l;
+
+  while (data < end){
+    nl = memchr(data, '\n', end - data);
+    l = (nl != NULL ? nl : end) - data;
+
+    //Whatever doesn't fit is dropped, up to the newline
+    if (f->len + l >= sizeof(f->line)){
+      l = sizeof(f->line) - 1 - f->len;
+      f->cut = true;
+    }
+    memcpy(f->line + f->len, data, l);
+    f->len += l;
+
+    if (nl == NULL){
+      return;
+    }
+    f->lines++;
+    line_filter_line(f);
+    data = nl + 1;
+  }
+}
+
+void line_filter_end(LineFilter *f){
+  if (f->len > 0 || f->cut){
+    line_filter_line(f);
+  }
+}
+
+bool line_filter_extract(const char *text, const char *pattern, int cflags, int group, char *buf, size_t size){
+  const regex_t *re = line_filter_regex(pattern, cflags);
+  regmatch_t m[10];
+  size_t n;
+
+  if (size == 0){
+    return false;
+  }
+  buf[0] = '\0';
+  if (re == NULL || group > 9 || regexec(re, text, group + 1, m, 0) != 0 || m[group].rm_so < 0){
+    return false;
+  }
+
+  n = m[group].rm_eo - m[group].rm_so;
+  if (n >= size){
+    n = size - 1;
+  }
+  memcpy(buf, text + m[group].rm_so, n);
+  buf[n] = '\0';
+  return true;
+}
@@ -2,151 +2,119 @@
 #include <spawn_programs.h>
 #include <helper_scripts.h>
 
+#include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 
-void menuscripts_powermenu(const Arg *a){
-  const char *prompt = "PowerMenu";
-  const char *menu_main[]       = {"Session", "Net Utilities", "Programs", "Misc", "Close", NULL};
+//POWER MENU
+//Each menu is one rofi run. Picking an entry (or dismissing the menu) shows the next one from the event loop
+enum {PowerMenuMain, PowerMenuSession, PowerMenuNet, PowerMenuTTY, PowerMenuPoweroff, PowerMenuReboot, PowerMenuEnd};
 
-  const char *menu_session[]    = {"Lock Screen", "Exit to TTY", "Power Off", "Reboot", "Back", NULL};
-  const char *menu_TTY[]        = {"Exit to TTY", "Stay in HorizonWM", NULL};
-  const char *menu_poweroff[]   = {"Power Off", "Power Offn't", NULL};
-  const char *menu_reboot[]     = {"Reboot", "Rebootn't", NULL};
+typedef struct MenuEntry {
+  const char *label;
+  int next;                                 //Menu shown next
+  void (*func)(const Arg *);                //Called when picked, may be NULL
+  Arg arg;
+} MenuEntry;
+
+typedef struct Menu {
+  MenuEntry entries[MENU_MAX_ENTRIES + 1];  //label NULL terminated
+  int back;                                 //Shown next when dismissed
+} Menu;
+
+static const Menu powermenu[] = {
+  [PowerMenuMain] = {{
+    {"Session",           PowerMenuSession,   NULL,       {0}},
+    {"Net Utilities",     PowerMenuNet,       NULL,       {0}},
+    {"Programs",          PowerMenuEnd,       spawn,      {.v = rofibarcmd}},
+    {"Misc",              PowerMenuEnd,       NULL,       {0}},
+    {"Close",             PowerMenuEnd,       NULL,       {0}},
+  }, PowerMenuEnd},
+  [PowerMenuSession] = {{
+    {"Lock Screen",       PowerMenuEnd,       lock_screen, {0}},
+    {"Exit to TTY",       PowerMenuTTY,       NULL,       {0}},
+    {"Power Off",         PowerMenuPoweroff,  NULL,       {0}},
+    {"Reboot",            PowerMenuReboot,    NULL,       {0}},
+    {"Back",              PowerMenuMain,      NULL,       {0}},
+  }, PowerMenuMain},
+  [PowerMenuNet] = {{
+    {"Connect to VPN",    PowerMenuEnd,       NULL,       {0}},   //TODO VPN
+    {"Enable Hotspot",    PowerMenuEnd,       NULL,       {0}},   //TODO HOTSPOT
+    {"Back",              PowerMenuMain,      NULL,       {0}},
+  }, PowerMenuMain},
+  [PowerMenuTTY] = {{
+    {"Exit to TTY",       PowerMenuEnd,       NULL,       {0}},   //TODO QUIT
+    {"Stay in HorizonWM", PowerMenuSession,   NULL,       {0}},
+  }, PowerMenuSession},
+  [PowerMenuPoweroff] = {{
+    {"Power Off",         PowerMenuEnd,       spawn,      {.v = poweroffcmd}},
+    {"Power Offn't",      PowerMenuSession,   NULL,       {0}},
+  }, PowerMenuSession},
+  [PowerMenuReboot] = {{
+    {"Reboot",            PowerMenuEnd,       spawn,      {.v = rebootcmd}},
+    {"Rebootn't",         PowerMenuSession,   NULL,       {0}},
+  }, PowerMenuSession},
+};
+
+static bool powermenu_open = false;
+
+static void powermenu_show(int menu);
+
+static void powermenu_picked(int selection, void *data){
+  const Menu *menu = &powermenu[(long) data];
+  int n;
+
+  for (n = 0; menu->entries[n].label != NULL; n++);
+  if (selection < 0 || selection >= n){
+    powermenu_show(menu->back);
+    return;
+  }
+  if (menu->entries[selection].func){
+    menu->entries[selection].func(&menu->entries[selection].arg);
+  }
+  powermenu_show(menu->entries[selection].next);
+}
 
-  const char *menu_net[]        = {"Connect to VPN", "Enable Hotspot", "Back", NULL};
+static void powermenu_show(int menu){
+  const char *options[MENU_MAX_ENTRIES + 1];
+  int i;
 
-  Arg arg;
+  if (menu == PowerMenuEnd){
+    powermenu_open = false;
+    return;
+  }
+  for (i = 0; powermenu[menu].entries[i].label != NULL; i++){
+    options[i] = powermenu[menu].entries[i].label;
+  }
+  options[i] = NULL;
 
-  int selection;
+  if (show_menu_rofi_async(ShowMenuTopRight, "PowerMenu", options, powermenu_picked, (void *)(long) menu) < 0){
+    powermenu_open = false;
+  }
+}
 
-  main_menu:
-    selection = show_menu_rofi(ShowMenuTopRight, prompt, menu_main);
-    switch(selection){
-      case 0:
-        goto session_menu;
-        break;
-      case 1:
-        goto network_menu;
-        break;
-      case 2:
-        arg.v = rofibarcmd;
-        spawn(&arg);
-        goto end;
-        break;
-      default:
-        goto end;
-        break;
-    }
-    goto end;
-
-  network_menu:
-    selection = show_menu_rofi(ShowMenuTopRight, prompt, menu_net);
-    switch(selection){
-      case 0:
-        //TODO VPN
-        goto end;
-        break;
-      case 1:
-        //TODO HOTSPOT
-        goto end;
-        break;
-      default:
-        goto main_menu;
-        break;
-    }
-    goto end;
-
-  session_menu:
-    selection = show_menu_rofi(ShowMenuTopRight, prompt, menu_session);
-    switch(selection){
-      case 0:
-        arg.v = lockscreencmd;
-        spawn(&arg);
-        goto end;
-        break;
-      case 1:
-        goto tty_menu;
-        break;
-      case 2:
-        goto poweroff_menu;
-        break;
-      case 3:
-        goto reboot_menu;
-        break;
-      default:
-        goto main_menu;
-        break;
-    }
-    goto end;
-
-  tty_menu:
-    selection = show_menu_rofi(ShowMenuTopRight, prompt, menu_TTY);
-    switch(selection){
-      case 0:
-        //TODO QUIT
-        goto end;
-        break;
-      default:
-        goto session_menu;
-        break;
-    }
-    goto end;
-
-  poweroff_menu:
-    selection = show_menu_rofi(ShowMenuTopRight, prompt, menu_poweroff);
-    switch(selection){
-      case 0:
-        arg.v = poweroffcmd;
-        spawn(&arg);
-        break;
-      default:
-        goto session_menu;
-        break;
-    }
-    goto end;
-
-  reboot_menu:
-    selection = show_menu_rofi(ShowMenuTopRight, prompt, menu_reboot);
-    switch(selection){
-      case 0:
-        arg.v = rebootcmd;
-        spawn(&arg);
-        break;
-      default:
-        goto session_menu;
-        break;
-    }
-    goto end;
-
-  end:
-      return;
+void menuscripts_powermenu(const Arg *a){
+  //rofi can't show two menus at once anyway
+  if (powermenu_open){
+    return;
+  }
+  powermenu_open = true;
+  powermenu_show(PowerMenuMain);
 }
 
-int show_menu_rofi(int position, const char *prompt, const char *options[]){
+//Options, one per line, in a string to be freed. NULL if there are none
+static char *show_menu_options(const char *options[]){
   size_t optslen = 0;
+  char *buffer;
   int numopts;
-  Arg a;
-  const char *selected_config = "";
-  switch(position){
-    case ShowMenuTopRight:
-      selected_config = ROFIBARCNFG;
-      break;
-    case ShowMenuFullscreen:
-      selected_config = ROFIFULLCNFG;
-      break;
-  }
-
-  const char *rofi_command[] = {"rofi", "-dmenu", "-format", "i", "-config", selected_config, "-p", prompt, NULL};
 
   for (numopts = 0; options[numopts] != NULL; numopts++){
     optslen += strlen(options[numopts]) + 1;
   }
 
-  if (optslen == 0){
-    return -1;
+  if (optslen == 0 || (buffer = malloc(optslen)) == NULL){
+    return NULL;
   }
-
-  char buffer[optslen];
   buffer[0] = '\0';
 
   for (int i = 0; i < numopts; i++){
@@ -155,9 +123,66 @@ int show_menu_rofi(int position, const char *prompt, const char *options[]){
   }
 
   buffer[optslen -1] = '\0';
+  return buffer;
+}
+
+static const char *show_menu_config(int position){
+  switch(position){
+    case ShowMenuTopRight:
+      return ROFIBARCNFG;
+    case ShowMenuFullscreen:
+      return ROFIFULLCNFG;
+  }
+  return "";
+}
+
+int show_menu_rofi(int position, const char *prompt, const char *options[]){
+  const char *rofi_command[] = {"rofi", "-dmenu", "-format", "i", "-config", show_menu_config(position), "-p", prompt, NULL};
+  char *buffer = show_menu_options(options);
+  int selection;
+  Arg a;
+
+  if (buffer == NULL){
+    return -1;
+  }
 
   a.v = rofi_command;
-  return spawn_readint_feedstdin(&a, buffer);
+  selection = spawn_readint_feedstdin(&a, buffer);
+  free(buffer);
+  return selection;
+}
+
+typedef struct ShowMenuRequest {
+  ShowMenuDone done;
+  void *data;
+} ShowMenuRequest;
+
+static void show_menu_rofi_exited(int status, const char *output, void *data){
+  ShowMenuRequest r = *(ShowMenuRequest *) data;
+
+  free(data);
+  //Nothing printed: dismissed
+  r.done(output[0] != '\0' ? atoi(output) : -1, r.data);
 }
 
+int show_menu_rofi_async(int position, const char *prompt, const char *options[], ShowMenuDone done, void *data){
+  const char *rofi_command[] = {"rofi", "-dmenu", "-format", "i", "-config", show_menu_config(position), "-p", prompt, NULL};
+  char *buffer = show_menu_options(options);
+  ShowMenuRequest *r = NULL;
 
+  if (buffer == NULL || (r = malloc(sizeof(ShowMenuRequest))) == NULL){
+    free(buffer);
+    return -1;
+  }
+  r->done = done;
+  r->data = data;
+
+  //rofi is fed the options and runs while the WM goes on. Its exit shows the selection
+  if (spawn_async(rofi_command, buffer, true, show_menu_rofi_exited, r) == NULL){
+    free(r);
+    free(buffer);
+    return -1;
+  }
+  free(buffer);
+  return 0;
+}
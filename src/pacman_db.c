@@ -0,0 +1,557 @@
+#include <pacman_db.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define PACMAN_NAMELEN      256
+#define TAR_BLOCK           512
+#define INFLATE_CHUNK       65536
+
+typedef struct LocalPackage {
+  char *name;
+  char *version;
+  char outdated;      //Set (atomically) by any sync db thread with a newer version
+} LocalPackage;
+
+//Installed packages, hashed by name. Read only while the sync db threads run
+typedef struct LocalDB {
+  LocalPackage *packages;
+  int npackages;
+  int *table;         //Open addressing, indexes into packages. -1 = empty
+  unsigned int tablesize;
+} LocalDB;
+
+typedef struct SyncScan {
+  char path[PATH_MAX];
+  LocalDB *local;
+  int error;
+
+  //Tar stream state
+  unsigned char header[TAR_BLOCK];
+  size_t header_fill;
+  unsigned long long skip;
+} SyncScan;
+
+static pthread_mutex_t mutex_pacman_db = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long cached_stamp = 0;
+static int cached_count = -1;
+
+static pthread_once_t db_path_once = PTHREAD_ONCE_INIT;
+static char db_path[PATH_MAX];
+
+//Same default as checkupdates: ${CHECKUPDATES_DB:-${TMPDIR:-/tmp}/checkup-db-$UID}
+static void db_path_init(void){
+  const char *path = getenv(PACMAN_DB_ENV), *tmp;
+
+  if (path == NULL){
+    path = getenv(PACMAN_CHECKUP_DB_ENV);
+  }
+  if (path != NULL && path[0] != '\0'){
+    snprintf(db_path, sizeof(db_path), "%s", path);
+    return;
+  }
+  if ((tmp = getenv("TMPDIR")) == NULL || tmp[0] == '\0'){
+    tmp = "/tmp";
+  }
+  snprintf(db_path, sizeof(db_path), "%s/checkup-db-%u", tmp, (unsigned int) getuid());
+}
+
+const char *pacman_db_path(void){
+  pthread_once(&db_path_once, db_path_init);
+  return db_path;
+}
+
+//VERSION COMPARISON (rpmvercmp and alpm_pkg_vercmp)
+static int rpmvercmp(const char *a, const char *b){
+  char str1[PACMAN_NAMELEN], str2[PACMAN_NAMELEN];
+  char *one, *two, *ptr1, *ptr2;
+  char oldch1, oldch2;
+  int isnum, rc;
+
+  if (strcmp(a, b) == 0){
+    return 0;
+  }
+
+  snprintf(str1, sizeof(str1), "%s", a);
+  snprintf(str2, sizeof(str2), "%s", b);
+  one = ptr1 = str1;
+  two = ptr2 = str2;
+
+  //Loop through each version segment of both strings and compare them
+  while (*one && *two){
+    while (*one && !isalnum((unsigned char) *one)) one++;
+    while (*two && !isalnum((unsigned char) *two)) two++;
+
+    if (!*one || !*two){
+      break;
+    }
+
+    //Different separator lengths, we are finished
+    if ((one - ptr1) != (two - ptr2)){
+      return (one - ptr1) < (two - ptr2) ? -1 : 1;
+    }
+
+    ptr1 = one;
+    ptr2 = two;
+
+    //Grab first completely alpha or completely numeric segment
+    if (isdigit((unsigned char) *ptr1)){
+      while (*ptr1 && isdigit((unsigned char) *ptr1)) ptr1++;
+      while (*ptr2 && isdigit((unsigned char) *ptr2)) ptr2++;
+      isnum = 1;
+    } else {
+      while (*ptr1 && isalpha((unsigned char) *ptr1)) ptr1++;
+      while (*ptr2 && isalpha((unsigned char) *ptr2)) ptr2++;
+      isnum = 0;
+    }
+
+    oldch1 = *ptr1;
+    *ptr1 = '\0';
+    oldch2 = *ptr2;
+    *ptr2 = '\0';
+
+    //Numeric segments are always newer than alpha segments
+    if (two == ptr2){
+      return isnum ? 1 : -1;
+    }
+
+    if (isnum){
+      while (*one == '0') one++;
+      while (*two == '0') two++;
+      if (strlen(one) != strlen(two)){
+        return strlen(one) > strlen(two) ? 1 : -1;
+      }
+    }
+
+    if ((rc = strcmp(one, two)) != 0){
+      return rc < 0 ? -1 : 1;
+    }
+
+    *ptr1 = oldch1;
+    one = ptr1;
+    *ptr2 = oldch2;
+    two = ptr2;
+  }
+
+  if (!*one && !*two){
+    return 0;
+  }
+
+  //A remaining alpha string never beats an empty string
+  if ((!*one && !isalpha((unsigned char) *two)) || isalpha((unsigned char) *one)){
+    return -1;
+  }
+  return 1;
+}
+
+//Splits [epoch:]version[-release] in place
+static void parse_evr(char *evr, const char **epoch, const char **version, const char **release){
+  char *s = evr, *se;
+
+  while (*s && isdigit((unsigned char) *s)) s++;
+  se = strrchr(s, '-');
+
+  if (*s == ':'){
+    *epoch = evr;
+    *s++ = '\0';
+    *version = s;
+    if (**epoch == '\0'){
+      *epoch = "0";
+    }
+  } else {
+    *epoch = "0";
+    *version = evr;
+  }
+
+  if (se){
+    *se++ = '\0';
+    *release = se;
+  } else {
+    *release = NULL;
+  }
+}
+
+int pacman_vercmp(const char *a, const char *b){
+  char full1[PACMAN_NAMELEN], full2[PACMAN_NAMELEN];
+  const char *epoch1, *ver1, *rel1, *epoch2, *ver2, *rel2;
+  int ret;
+
+  if (strcmp(a, b) == 0){
+    return 0;
+  }
+
+  snprintf(full1, sizeof(full1), "%s", a);
+  snprintf(full2, sizeof(full2), "%s", b);
+  parse_evr(full1, &epoch1, &ver1, &rel1);
+  parse_evr(full2, &epoch2, &ver2, &rel2);
+
+  if ((ret = rpmvercmp(epoch1, epoch2)) == 0){
+    if ((ret = rpmvercmp(ver1, ver2)) == 0 && rel1 && rel2){
+      ret = rpmvercmp(rel1, rel2);
+    }
+  }
+  return ret;
+}
+
+//Package entries are named "name-pkgver-pkgrel". Neither pkgver nor pkgrel may contain '-'.
+//Returns pointer to the version inside entry, after terminating the name. NULL if malformed
+static char *split_name_version(char *entry){
+  char *rel, *ver;
+
+  if ((rel = strrchr(entry, '-')) == NULL || rel == entry){
+    return NULL;
+  }
+  *rel = '\0';
+  ver = strrchr(entry, '-');
+  *rel = '-';
+  if (ver == NULL || ver == entry){
+    return NULL;
+  }
+  *ver = '\0';
+  return ver + 1;
+}
+
+static unsigned int hash_name(const char *s){
+  unsigned int h = 2166136261u;   //FNV-1a
+  while (*s){
+    h = (h ^ (unsigned char) *s++) * 16777619u;
+  }
+  return h;
+}
+
+static LocalPackage *localdb_find(LocalDB *db, const char *name){
+  unsigned int i = hash_name(name) & (db->tablesize - 1);
+  while (db->table[i] >= 0){
+    if (strcmp(db->packages[db->table[i]].name, name) == 0){
+      return &db->packages[db->table[i]];
+    }
+    i = (i + 1) & (db->tablesize - 1);
+  }
+  return NULL;
+}
+
+static void localdb_free(LocalDB *db){
+  for (int i = 0; i < db->npackages; i++){
+    free(db->packages[i].name);   //version points inside the same allocation
+  }
+  free(db->packages);
+  free(db->table);
+}
+
+static int localdb_load(LocalDB *db, const char *dbpath){
+  char path[PATH_MAX];
+  struct dirent *dir;
+  int capacity = 1024;
+  char *entry, *version;
+  LocalPackage *grown;
+  unsigned int i;
+  DIR *d;
+
+  snprintf(path, sizeof(path), "%s/local", dbpath);
+  if ((d = opendir(path)) == NULL){
+    return -1;
+  }
+
+  memset(db, 0, sizeof(LocalDB));
+  if ((db->packages = malloc(capacity * sizeof(LocalPackage))) == NULL){
+    closedir(d);
+    return -1;
+  }
+
+  //The directory names already hold name and version, no need to open every desc file
+  while ((dir = readdir(d)) != NULL){
+    if (dir->d_name[0] == '.' || strcmp(dir->d_name, "ALPM_DB_VERSION") == 0){
+      continue;
+    }
+    if ((entry = strdup(dir->d_name)) == NULL){
+      continue;
+    }
+    if ((version = split_name_version(entry)) == NULL){
+      free(entry);
+      continue;
+    }
+    if (db->npackages == capacity){
+      //The old array is still ours if it can't grow
+      if ((grown = realloc(db->packages, capacity * 2 * sizeof(LocalPackage))) == NULL){
+        free(entry);
+        closedir(d);
+        localdb_free(db);
+        return -1;
+      }
+      db->packages = grown;
+      capacity *= 2;
+    }
+    db->packages[db->npackages].name = entry;
+    db->packages[db->npackages].version = version;
+    db->packages[db->npackages].outdated = 0;
+    db->npackages++;
+  }
+  closedir(d);
+
+  for (db->tablesize = 64; db->tablesize < (unsigned int) db->npackages * 2; db->tablesize *= 2);
+  if ((db->table = malloc(db->tablesize * sizeof(int))) == NULL){
+    localdb_free(db);
+    return -1;
+  }
+  memset(db->table, 0xff, db->tablesize * sizeof(int));
+  for (int p = 0; p < db->npackages; p++){
+    i = hash_name(db->packages[p].name) & (db->tablesize - 1);
+    while (db->table[i] >= 0){
+      i = (i + 1) & (db->tablesize - 1);
+    }
+    db->table[i] = p;
+  }
+
+  return 0;
+}
+
+//SYNC DATABASES
+static unsigned long long tar_octal(const unsigned char *field, size_t len){
+  unsigned long long v = 0;
+  for (size_t i = 0; i < len && field[i] >= '0' && field[i] <= '7'; i++){
+    v = v * 8 + (field[i] - '0');
+  }
+  return v;
+}
+
+//Every package has exactly one "name-pkgver-pkgrel/desc" member
+static void sync_entry(SyncScan *scan, const char *member){
+  char entry[PACMAN_NAMELEN];
+  LocalPackage *p;
+  const char *slash;
+  char *version;
+
+  if ((slash = strchr(member, '/')) == NULL || strcmp(slash, "/desc") != 0){
+    return;
+  }
+  if ((size_t) (slash - member) >= sizeof(entry)){
+    return;
+  }
+  memcpy(entry, member, slash - member);
+  entry[slash - member] = '\0';
+
+  if ((version = split_name_version(entry)) == NULL){
+    return;
+  }
+  if ((p = localdb_find(scan->local, entry)) != NULL && pacman_vercmp(version, p->version) > 0){
+    __atomic_store_n(&p->outdated, 1, __ATOMIC_RELAXED);
+  }
+}
+
+//Consumes the (decompressed) tar stream in arbitrary chunks. Member contents are skipped
+static void tar_feed(SyncScan *scan, const unsigned char *data, size_t len){
+  char member[TAR_BLOCK];
+  unsigned long long size;
+  size_t n;
+
+  while (len > 0){
+    if (scan->skip > 0){
+      n = scan->skip < len ? scan->skip : len;
+      scan->skip -= n;
+      data += n;
+      len -= n;
+      continue;
+    }
+
+    n = TAR_BLOCK - scan->header_fill < len ? TAR_BLOCK - scan->header_fill : len;
+    memcpy(scan->header + scan->header_fill, data, n);
+    scan->header_fill += n;
+    data += n;
+    len -= n;
+    if (scan->header_fill < TAR_BLOCK){
+      return;
+    }
+    scan->header_fill = 0;
+
+    if (scan->header[0] == '\0'){   //End of archive padding
+      continue;
+    }
+
+    size = tar_octal(scan->header + 124, 12);
+    scan->skip = (size + TAR_BLOCK - 1) & ~((unsigned long long) TAR_BLOCK - 1);
+
+    //ustar prefix (offset 345) + name (offset 0)
+    if (scan->header[345] != '\0' && memcmp(scan->header + 257, "ustar", 5) == 0){
+      snprintf(member, sizeof(member), "%.155s/%.100s", scan->header + 345, scan->header);
+    } else {
+      snprintf(member, sizeof(member), "%.100s", scan->header);
+    }
+    sync_entry(scan, member);
+  }
+}
+
+static void *sync_db_scan(void *args){
+  SyncScan *scan = args;
+  unsigned char out[INFLATE_CHUNK];
+  unsigned char *map;
+  struct stat st;
+  z_stream z;
+  int fd, ret;
+
+  if ((fd = open(scan->path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0){
+    scan->error = 1;
+    if (fd >= 0){
+      close(fd);
+    }
+    return NULL;
+  }
+  if (st.st_size == 0){
+    close(fd);
+    return NULL;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED){
+    scan->error = 1;
+    return NULL;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  if (st.st_size > 2 && map[0] == 0x1f && map[1] == 0x8b){
+    //gzip, inflated in chunks straight into the tar parser
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, 15 + 16) != Z_OK){
+      scan->error = 1;
+      goto sync_db_scan_end;
+    }
+    z.next_in = map;
+    z.avail_in = st.st_size;
+    do {
+      z.next_out = out;
+      z.avail_out = sizeof(out);
+      ret = inflate(&z, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END){
+        scan->error = 1;
+        break;
+      }
+      tar_feed(scan, out, sizeof(out) - z.avail_out);
+    } while (ret != Z_STREAM_END);
+    inflateEnd(&z);
+  } else if (st.st_size > 262 && memcmp(map + 257, "ustar", 5) == 0){
+    tar_feed(scan, map, st.st_size);
+  } else {
+    scan->error = 1;    //zstd, xz, ... compressed databases are not supported
+  }
+
+  sync_db_scan_end:
+  munmap(map, st.st_size);
+  return NULL;
+}
+
+//Cheap fingerprint of local/ and every sync db. Changes whenever pacman touches them
+static unsigned long long db_stamp(const char *dbpath, char paths[][PATH_MAX], int *ndbs){
+  unsigned long long stamp = 1469598103934665603ull;
+  char path[PATH_MAX];
+  struct dirent *dir;
+  struct stat st;
+  size_t len;
+  DIR *d;
+
+  *ndbs = 0;
+
+  snprintf(path, sizeof(path), "%s/local", dbpath);
+  if (stat(path, &st) < 0){
+    return 0;
+  }
+  stamp = (stamp ^ st.st_mtim.tv_sec) * 1099511628211ull;
+  stamp = (stamp ^ st.st_mtim.tv_nsec) * 1099511628211ull;
+
+  snprintf(path, sizeof(path), "%s/sync", dbpath);
+  if ((d = opendir(path)) == NULL){
+    return 0;
+  }
+  while ((dir = readdir(d)) != NULL && *ndbs < PACMAN_MAX_SYNC_DBS){
+    len = strlen(dir->d_name);
+    if (len < 4 || strcmp(dir->d_name + len - 3, ".db") != 0){
+      continue;
+    }
+    if (snprintf(paths[*ndbs], PATH_MAX, "%s/%s", path, dir->d_name) >= PATH_MAX || stat(paths[*ndbs], &st) < 0){
+      continue;
+    }
+    stamp = (stamp ^ st.st_mtim.tv_sec) * 1099511628211ull;
+    stamp = (stamp ^ st.st_mtim.tv_nsec) * 1099511628211ull;
+    stamp = (stamp ^ st.st_size) * 1099511628211ull;
+    stamp = (stamp ^ hash_name(dir->d_name)) * 1099511628211ull;
+    (*ndbs)++;
+  }
+  closedir(d);
+
+  return stamp;
+}
+
+int pacman_db_count_updates(const char *dbpath){
+  static char paths[PACMAN_MAX_SYNC_DBS][PATH_MAX];
+  pthread_t threads[PACMAN_MAX_SYNC_DBS];
+  SyncScan *scans;
+  unsigned long long stamp;
+  LocalDB local;
+  int ndbs, count = 0;
+
+  pthread_mutex_lock(&mutex_pacman_db);
+
+  stamp = db_stamp(dbpath, paths, &ndbs);
+  if (stamp == 0){
+    count = -1;
+    goto pacman_db_count_updates_end;
+  }
+  if (stamp == cached_stamp){
+    count = cached_count;
+    goto pacman_db_count_updates_end;
+  }
+
+  if (localdb_load(&local, dbpath) < 0){
+    count = -1;
+    goto pacman_db_count_updates_end;
+  }
+
+  //One thread per sync db. They only read the local db and set outdated flags
+  if ((scans = calloc(ndbs > 0 ? ndbs : 1, sizeof(SyncScan))) == NULL){
+    localdb_free(&local);
+    count = -1;
+    goto pacman_db_count_updates_end;
+  }
+  for (int i = 0; i < ndbs; i++){
+    memcpy(scans[i].path, paths[i], PATH_MAX);
+    scans[i].local = &local;
+    if (pthread_create(&threads[i], NULL, sync_db_scan, &scans[i]) != 0){
+      sync_db_scan(&scans[i]);
+      threads[i] = 0;
+    }
+  }
+  for (int i = 0; i < ndbs; i++){
+    if (threads[i]){
+      pthread_join(threads[i], NULL);
+    }
+  }
+
+  for (int i = 0; i < local.npackages; i++){
+    count += local.packages[i].outdated;
+  }
+
+  //Failed dbs would give a wrong count. Report the error and try again next time
+  for (int i = 0; i < ndbs; i++){
+    if (scans[i].error){
+      count = -1;
+    }
+  }
+  cached_stamp = count < 0 ? 0 : stamp;
+  cached_count = count;
+
+  free(scans);
+  localdb_free(&local);
+
+  pacman_db_count_updates_end:
+  pthread_mutex_unlock(&mutex_pacman_db);
+  return count;
+}
@@ -0,0 +1,142 @@
+#include <power_policy.h>
+#include <power_supply.h>
+#include <bar_scheduler.h>
+#include <display_state.h>
+#include <event_loop.h>
+#include <sysfs.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+static const PowerPolicy power_policies[] = {
+  //profile                     name            module periods (%)    checker sleeps (%)
+  [POWER_PROFILE_PERFORMANCE] = {"performance",  50,                   50},
+  [POWER_PROFILE_BALANCED]    = {"balanced",     100,                  100},
+  [POWER_PROFILE_POWER_SAVER] = {"power-saver",  300,                  400},
+};
+
+/* compile-time check if every profile has a policy */
+struct NumPowerPolicies { char limitexceeded[sizeof power_policies / sizeof power_policies[0] != NumPowerProfiles ? -1 : 1]; };
+
+//ACPI platform_profile choices, as power-profiles-daemon maps them
+static const struct {
+  const char *name;
+  PowerProfile profile;
+} platform_profiles[] = {
+  {"low-power",             POWER_PROFILE_POWER_SAVER},
+  {"cool",                  POWER_PROFILE_POWER_SAVER},
+  {"quiet",                 POWER_PROFILE_POWER_SAVER},
+  {"balanced",              POWER_PROFILE_BALANCED},
+  {"balanced-performance",  POWER_PROFILE_PERFORMANCE},
+  {"performance",           POWER_PROFILE_PERFORMANCE},
+  {NULL,                    POWER_PROFILE_BALANCED},
+};
+
+static pthread_mutex_t mutex_power_policy = PTHREAD_MUTEX_INITIALIZER;
+static PowerProfile profile = POWER_PROFILE_BALANCED;
+static int fixed_profile = -1;          //From POWER_PROFILE_ENV
+static int platform_fd = -1;
+
+static PowerProfile profile_from_name(const char *name, size_t len){
+  for (int i = 0; platform_profiles[i].name != NULL; i++){
+    if (strlen(platform_profiles[i].name) == len && strncmp(platform_profiles[i].name, name, len) == 0){
+      return platform_profiles[i].profile;
+    }
+  }
+  for (int i = 0; i < NumPowerProfiles; i++){
+    if (strlen(power_policies[i].name) == len && strncmp(power_policies[i].name, name, len) == 0){
+      return i;
+    }
+  }
+  return POWER_PROFILE_BALANCED;
+}
+
+static PowerProfile platform_profile(void){
+  char value[32];
+  ssize_t n;
+
+  //Reading from offset 0 also rearms the sysfs_notify() poll
+  if (platform_fd < 0 || (n = pread(platform_fd, value, sizeof(value) - 1, 0)) <= 0){
+    return POWER_PROFILE_BALANCED;
+  }
+  value[n] = '\0';
+  return profile_from_name(value, strcspn(value, "\n"));
+}
+
+static PowerProfile power_policy_resolve(void){
+  int p;
+
+  if (fixed_profile >= 0){
+    return fixed_profile;
+  }
+
+  p = platform_profile();
+  p += power_supply_on_ac() ? -1 : 1;
+  if (p < 0) p = 0;
+  if (p >= NumPowerProfiles) p = NumPowerProfiles - 1;
+  return p;
+}
+
+//The kernel signals platform profile changes with POLLPRI
+static void platform_profile_handler(int fd, short revents, void *data){
+  power_policy_check();
+}
+
+void power_policy_check(void){
+  PowerProfile p = power_policy_resolve();
+
+  pthread_mutex_lock(&mutex_power_policy);
+  if (p == profile){
+    pthread_mutex_unlock(&mutex_power_policy);
+    return;
+  }
+  profile = p;
+  pthread_mutex_unlock(&mutex_power_policy);
+
+  //Running threads and timers pick up the new intervals right away
+  bar_scheduler_rearm();
+  display_sleep_reschedule();
+}
+
+void power_policy_init(void){
+  char path[SYSFS_ATTR_PATHLEN];
+  const char *env;
+
+  if ((env = getenv(POWER_PROFILE_ENV)) != NULL){
+    fixed_profile = profile_from_name(env, strlen(env));
+  }
+
+  snprintf(path, sizeof(path), "%s/%s", sysfs_root(), POWER_PLATFORM_PROFILE);
+  if (fixed_profile < 0 && (platform_fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0){
+    event_loop_watch(platform_fd, POLLPRI, platform_profile_handler, NULL);
+  }
+
+  profile = power_policy_resolve();
+}
+
+PowerProfile power_policy_profile(void){
+  PowerProfile p;
+
+  pthread_mutex_lock(&mutex_power_policy);
+  p = profile;
+  pthread_mutex_unlock(&mutex_power_policy);
+
+  return p;
+}
+
+static unsigned int scale(unsigned int value, unsigned int percent){
+  value = (value * percent + 50) / 100;
+  return value > 0 ? value : 1;
+}
+
+unsigned int power_policy_period(unsigned int period){
+  return scale(period, power_policies[power_policy_profile()].period_percent);
+}
+
+unsigned int power_policy_sleep(unsigned int seconds){
+  return scale(seconds, power_policies[power_policy_profile()].sleep_percent);
+}
@@ -0,0 +1,261 @@
+#include <power_supply.h>
+#include <helper_scripts.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <unistd.h>
+
+static Battery batteries[POWER_MAX_BATTERIES];
+static int n_batteries = 0;
+
+static SysfsAttr *adapters[POWER_MAX_ADAPTERS];   //"online" attribute of each adapter
+static int n_adapters = 0;
+
+static Backlight backlight;
+static bool has_backlight = false;
+
+static float tte_smoothed = -1;
+
+//Returns the attribute root/class/<subsystem>/<device>/<attr>, or NULL if it doesn't exist
+static SysfsAttr *device_attr(const char *folder, const char *attr){
+  char path[SYSFS_ATTR_PATHLEN];
+  snprintf(path, sizeof(path), "%s/%s", folder, attr);
+  if (access(path, R_OK) != 0){
+    return NULL;
+  }
+  return sysfs_attr_get(path);
+}
+
+static void read_device_string(const char *folder, const char *attr, char *buf, size_t size){
+  char path[SYSFS_ATTR_PATHLEN];
+  snprintf(path, sizeof(path), "%s/%s", folder, attr);
+  if (read_file_string(path, buf, size) < 0){
+    buf[0] = '\0';
+  }
+  buf[strcspn(buf, "\n")] = '\0';
+}
+
+static void discover_power_supplies(const char *root){
+  char class_folder[SYSFS_ATTR_PATHLEN];
+  char folder[SYSFS_ATTR_PATHLEN];
+  char type[32];
+  char scope[32];
+  struct dirent *dir;
+  Battery *b;
+  DIR *d;
+
+  snprintf(class_folder, sizeof(class_folder), "%s/class/power_supply", root);
+  if ((d = opendir(class_folder)) == NULL){
+    return;
+  }
+
+  while ((dir = readdir(d)) != NULL){
+    if (dir->d_name[0] == '.'){
+      continue;
+    }
+    if (snprintf(folder, sizeof(folder), "%s/%s", class_folder, dir->d_name) >= sizeof(folder)){
+      continue;
+    }
+    read_device_string(folder, "type", type, sizeof(type));
+
+    if (strcmp(type, "Battery") == 0){
+      //Skip batteries of mice, keyboards, ...
+      read_device_string(folder, "scope", scope, sizeof(scope));
+      if (strcmp(scope, "Device") == 0 || n_batteries >= POWER_MAX_BATTERIES){
+        continue;
+      }
+
+      b = &batteries[n_batteries];
+      memset(b, 0, sizeof(Battery));
+      snprintf(b->name, POWER_NAMELEN, "%.*s", POWER_NAMELEN - 1, dir->d_name);
+
+      if ((b->now = device_attr(folder, "energy_now"))){
+        b->energy = true;
+        b->full = device_attr(folder, "energy_full");
+        b->rate = device_attr(folder, "power_now");
+      } else if ((b->now = device_attr(folder, "charge_now"))){
+        b->energy = false;
+        b->full = device_attr(folder, "charge_full");
+        b->rate = device_attr(folder, "current_now");
+        if ((b->voltage = device_attr(folder, "voltage_min_design")) == NULL){
+          b->voltage = device_attr(folder, "voltage_now");
+        }
+      }
+      b->capacity = device_attr(folder, "capacity");
+      b->status = device_attr(folder, "status");
+
+      if ((b->now && b->full) || b->capacity){
+        n_batteries++;
+      }
+    } else if (strcmp(type, "Mains") == 0 || strncmp(type, "USB", 3) == 0){
+      if (n_adapters < POWER_MAX_ADAPTERS && (adapters[n_adapters] = device_attr(folder, "online"))){
+        n_adapters++;
+      }
+    }
+  }
+
+  closedir(d);
+}
+
+static void discover_backlights(const char *root){
+  //Kernel recommended preference: firmware, then platform, then raw
+  const char *type_priority[] = {"firmware", "platform", "raw", NULL};
+  char class_folder[SYSFS_ATTR_PATHLEN];
+  char folder[SYSFS_ATTR_PATHLEN];
+  char type[32];
+  int best = -1, priority;
+  struct dirent *dir;
+  DIR *d;
+
+  snprintf(class_folder, sizeof(class_folder), "%s/class/backlight", root);
+  if ((d = opendir(class_folder)) == NULL){
+    return;
+  }
+
+  while ((dir = readdir(d)) != NULL){
+    if (dir->d_name[0] == '.'){
+      continue;
+    }
+    if (snprintf(folder, sizeof(folder), "%s/%s", class_folder, dir->d_name) >= sizeof(folder)){
+      continue;
+    }
+    read_device_string(folder, "type", type, sizeof(type));
+
+    for (priority = 0; type_priority[priority] != NULL; priority++){
+      if (strcmp(type, type_priority[priority]) == 0){
+        break;
+      }
+    }
+    if (best >= 0 && priority >= best){
+      continue;
+    }
+
+    SysfsAttr *brightness = device_attr(folder, "brightness");
+    SysfsAttr *max_brightness = device_attr(folder, "max_brightness");
+    if (brightness == NULL || max_brightness == NULL || sysfs_attr_int(max_brightness) <= 0){
+      continue;
+    }
+
+    best = priority;
+    snprintf(backlight.name, POWER_NAMELEN, "%.*s", POWER_NAMELEN - 1, dir->d_name);
+    snprintf(backlight.folder, SYSFS_ATTR_PATHLEN, "%s", folder);
+    backlight.brightness = brightness;
+    backlight.max_brightness = max_brightness;
+    has_backlight = true;
+  }
+
+  closedir(d);
+}
+
+void power_supply_discover(const char *root){
+  n_batteries = 0;
+  n_adapters = 0;
+  has_backlight = false;
+  tte_smoothed = -1;
+
+  discover_power_supplies(root);
+  discover_backlights(root);
+}
+
+int power_supply_read(PowerStatus *s){
+  float total_now = 0, total_full = 0, total_rate = 0, total_percent = 0;
+  float now, full, volts;
+  char status[SYSFS_ATTR_VALUELEN];
+  bool was_discharging;
+  int npercent = 0;
+  Battery *b;
+
+  memset(s, 0, sizeof(PowerStatus));
+  s->minutes_left = -1;
+  s->nbatteries = n_batteries;
+
+  for (int i = 0; i < n_adapters; i++){
+    if (sysfs_attr_int(adapters[i])){
+      s->on_ac = true;
+    }
+  }
+
+  if (n_batteries == 0){
+    return -1;
+  }
+
+  //One pass over every battery. Charge based batteries are converted to energy so they can be added up.
+  //Those that can't be (no voltage, or only a capacity) are just a percentage, only used if no battery gives energy
+  for (int i = 0; i < n_batteries; i++){
+    b = &batteries[i];
+
+    if (sysfs_attr_read(b->status, status, sizeof(status)) == 0 && strncmp(status, "Charging", 8) == 0){
+      s->charging = true;
+    }
+
+    if (b->now && b->full){
+      now = sysfs_attr_float(b->now);
+      full = sysfs_attr_float(b->full);
+      volts = b->energy ? 1 : b->voltage ? sysfs_attr_float(b->voltage) / 1e6 : 0;
+      if (volts > 0){
+        total_now += now * volts;
+        total_full += full * volts;
+        total_rate += b->rate ? fabsf(sysfs_attr_float(b->rate)) * volts : 0;
+        continue;
+      }
+      if (full > 0){
+        total_percent += 100 * now / full;
+        npercent++;
+        continue;
+      }
+    }
+    if (b->capacity){
+      total_percent += sysfs_attr_float(b->capacity);
+      npercent++;
+    }
+  }
+
+  if (total_full <= 0 && npercent == 0){
+    return -1;
+  }
+
+  //If battery is at 99.something, show it as 100.
+  float percentf = total_full > 0 ? 100 * total_now / total_full : total_percent / npercent;
+  s->percent = percentf > 99 ? 100 : (int) percentf;
+  s->power_w = total_rate / 1e6;
+
+  //Time to empty, smoothed with an exponential moving average so it doesn't jump around every refresh
+  was_discharging = tte_smoothed >= 0;
+  if (!s->on_ac && !s->charging && total_rate > 0){
+    float sample = 60 * total_now / total_rate;
+    tte_smoothed = was_discharging ? tte_smoothed + POWER_TTE_SMOOTHING * (sample - tte_smoothed) : sample;
+    s->minutes_left = (int) tte_smoothed;
+  } else {
+    tte_smoothed = -1;
+  }
+
+  return 0;
+}
+
+bool power_supply_on_ac(void){
+  char status[SYSFS_ATTR_VALUELEN];
+
+  for (int i = 0; i < n_adapters; i++){
+    if (sysfs_attr_int(adapters[i])){
+      return true;
+    }
+  }
+  if (n_adapters > 0){
+    return false;
+  }
+
+  //No adapter exposed. Discharging batteries mean we are on battery, no batteries mean a desktop
+  for (int i = 0; i < n_batteries; i++){
+    if (sysfs_attr_read(batteries[i].status, status, sizeof(status)) == 0 && strncmp(status, "Discharging", 11) == 0){
+      return false;
+    }
+  }
+  return true;
+}
+
+Backlight *backlight_get(void){
+  return has_backlight ? &backlight : NULL;
+}
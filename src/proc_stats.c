@@ -0,0 +1,409 @@
+#include <proc_stats.h>
+#include <sysfs.h>
+#include <helper_scripts.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static char stat_buf[4096];       //Only the aggregated "cpu" line is needed, it comes first
+static char meminfo_buf[4096];
+static char netdev_buf[16384];
+static char diskstats_buf[32768];
+
+static CpuStats cpu_stats;
+static MemStats mem_stats;
+static NetStats net_stats;
+static DiskStats disk_stats;
+
+static struct timespec cpu_time, net_time, disk_time, mem_time;
+
+//Kept open in the sysfs attribute registry, with a buffer of its own, so it is reread in the same batch as the rest
+typedef struct ProcFile {
+  const char *path;
+  char *buf;
+  int size;
+  struct timespec *time;      //Of the last sample taken from it
+  SysfsAttr *attr;
+} ProcFile;
+
+static ProcFile proc_stat      = {"/proc/stat",      stat_buf,      sizeof(stat_buf),      &cpu_time,  NULL};
+static ProcFile proc_meminfo   = {"/proc/meminfo",   meminfo_buf,   sizeof(meminfo_buf),   &mem_time,  NULL};
+static ProcFile proc_netdev    = {"/proc/net/dev",   netdev_buf,    sizeof(netdev_buf),    &net_time,  NULL};
+static ProcFile proc_diskstats = {"/proc/diskstats", diskstats_buf, sizeof(diskstats_buf), &disk_time, NULL};
+static ProcFile *proc_files[] = {&proc_stat, &proc_meminfo, &proc_netdev, &proc_diskstats, NULL};
+
+static SysfsAttr *hwmon_temp = NULL;
+static bool hwmon_discovered = false;
+
+//hwmon drivers reporting the CPU package temperature, by preference
+static const char *hwmon_names[] = {"coretemp", "k10temp", "zenpower", "cpu_thermal", "acpitz", NULL};
+
+//Seconds since t
+static double since(const struct timespec *t){
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - t->tv_sec) + (now.tv_nsec - t->tv_nsec) / 1e9;
+}
+
+//Brings the file up to date in its buffer, NUL terminated. Registers it on first use
+static int proc_file_read(ProcFile *f){
+  if (f->attr == NULL && (f->attr = sysfs_attr_get_buffer(f->path, f->buf, f->size)) == NULL){
+    return -1;
+  }
+  //Not expired by proc_stats_expire() before the last batch: reread on its own
+  if (since(&f->attr->read_time) >= PROC_STATS_MIN_INTERVAL){
+    sysfs_attr_invalidate(f->path);
+  }
+  return sysfs_attr_read(f->attr, NULL, 0);
+}
+
+void proc_stats_expire(void){
+  for (int i = 0; proc_files[i] != NULL; i++){
+    if (proc_files[i]->attr != NULL && since(proc_files[i]->time) >= PROC_STATS_MIN_INTERVAL){
+      sysfs_attr_invalidate(proc_files[i]->path);
+    }
+  }
+  if (hwmon_temp != NULL){
+    sysfs_attr_invalidate(hwmon_temp->path);
+  }
+}
+
+//Skips to the next number and parses it. *p is left after its last digit
+static unsigned long long parse_ull(const char **p){
+  unsigned long long v = 0;
+  const char *s = *p;
+
+  while (*s && *s != '\n' && (*s < '0' || *s > '9')){
+    s++;
+  }
+  while (*s >= '0' && *s <= '9'){
+    v = v * 10 + (*s++ - '0');
+  }
+  *p = s;
+  return v;
+}
+
+//Copies the next whitespace delimited token (up to delim) into name
+static void parse_name(const char **p, char *name, int size, char delim){
+  const char *s = *p;
+  int i = 0;
+
+  while (*s == ' ' || *s == '\t'){
+    s++;
+  }
+  while (*s && *s != delim && *s != ' ' && *s != '\n'){
+    if (i < size - 1){
+      name[i++] = *s;
+    }
+    s++;
+  }
+  name[i] = '\0';
+  *p = s;
+}
+
+static const char *next_line(const char *s){
+  while (*s && *s != '\n'){
+    s++;
+  }
+  return *s ? s + 1 : s;
+}
+
+//Seconds since last, and updates last. -1 if too soon to compute a rate
+static double elapsed(struct timespec *last){
+  double dt = since(last);
+
+  if (last->tv_sec != 0 && dt < PROC_STATS_MIN_INTERVAL){
+    return -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, last);
+  return dt;
+}
+
+CpuStats *proc_stats_cpu(void){
+  unsigned long long v, total = 0, idle = 0;
+  const char *p;
+
+  if (elapsed(&cpu_time) < 0 || proc_file_read(&proc_stat) < 0){
+    return &cpu_stats;
+  }
+
+  //cpu user nice system idle iowait irq softirq steal guest guest_nice. guest is already in user
+  p = proc_stat.buf + 3;
+  for (int i = 0; i < 8; i++){
+    v = parse_ull(&p);
+    total += v;
+    if (i == 3 || i == 4){
+      idle += v;
+    }
+  }
+
+  if (cpu_stats.total != 0 && total > cpu_stats.total){
+    //iowait may go backwards, keep the result in range
+    cpu_stats.usage = 100.0 * (1.0 - (double) (long long) (idle - cpu_stats.idle) / (total - cpu_stats.total));
+    cpu_stats.usage = cpu_stats.usage < 0 ? 0 : cpu_stats.usage > 100 ? 100 : cpu_stats.usage;
+  }
+  cpu_stats.total = total;
+  cpu_stats.idle = idle;
+
+  return &cpu_stats;
+}
+
+MemStats *proc_stats_mem(void){
+  const char *p;
+  int found = 0;
+
+  if (elapsed(&mem_time) < 0 || proc_file_read(&proc_meminfo) < 0){
+    return &mem_stats;
+  }
+
+  for (p = proc_meminfo.buf; *p && found < 2; p = next_line(p)){
+    if (strncmp(p, "MemTotal:", 9) == 0){
+      mem_stats.total_kb = parse_ull(&p);
+      found++;
+    } else if (strncmp(p, "MemAvailable:", 13) == 0){
+      mem_stats.available_kb = parse_ull(&p);
+      found++;
+    }
+  }
+
+  if (mem_stats.total_kb > 0){
+    mem_stats.usage = 100.0 * (mem_stats.total_kb - mem_stats.available_kb) / mem_stats.total_kb;
+  }
+
+  return &mem_stats;
+}
+
+static NetIface *net_iface(const char *name){
+  NetIface *iface;
+
+  for (int i = 0; i < net_stats.nifaces; i++){
+    if (strcmp(net_stats.ifaces[i].name, name) == 0){
+      return &net_stats.ifaces[i];
+    }
+  }
+  if (net_stats.nifaces >= PROC_MAX_IFACES){
+    return NULL;
+  }
+  iface = &net_stats.ifaces[net_stats.nifaces++];
+  memset(iface, 0, sizeof(NetIface));
+  strcpy(iface->name, name);
+  return iface;
+}
+
+NetStats *proc_stats_net(void){
+  unsigned long long rx, tx;
+  char name[PROC_NAMELEN];
+  NetIface *iface;
+  const char *p;
+  double dt;
+
+  if ((dt = elapsed(&net_time)) < 0 || proc_file_read(&proc_netdev) < 0){
+    return &net_stats;
+  }
+
+  //Interfaces missing from the previous sample are gone (veths, tun): their slot is freed
+  int kept = 0;
+  for (int i = 0; i < net_stats.nifaces; i++){
+    if (net_stats.ifaces[i].seen){
+      net_stats.ifaces[kept] = net_stats.ifaces[i];
+      net_stats.ifaces[kept++].seen = false;
+    }
+  }
+  net_stats.nifaces = kept;
+  net_stats.rx_rate = net_stats.tx_rate = 0;
+
+  //Two header lines, then "iface: rx_bytes packets errs drop fifo frame compressed multicast tx_bytes ..."
+  p = next_line(next_line(proc_netdev.buf));
+  for (; *p; p = next_line(p)){
+    parse_name(&p, name, sizeof(name), ':');
+    if (*p != ':' || (iface = net_iface(name)) == NULL){
+      continue;
+    }
+    p++;
+    rx = parse_ull(&p);
+    for (int i = 0; i < 7; i++){
+      parse_ull(&p);
+    }
+    tx = parse_ull(&p);
+
+    //A counter going back means the interface was recreated
+    if (iface->rx_bytes != 0 && rx >= iface->rx_bytes && tx >= iface->tx_bytes){
+      iface->rx_rate = (rx - iface->rx_bytes) / dt;
+      iface->tx_rate = (tx - iface->tx_bytes) / dt;
+    } else {
+      iface->rx_rate = iface->tx_rate = 0;
+    }
+    iface->rx_bytes = rx;
+    iface->tx_bytes = tx;
+    iface->seen = true;
+
+    if (strcmp(name, "lo") != 0){
+      net_stats.rx_rate += iface->rx_rate;
+      net_stats.tx_rate += iface->tx_rate;
+    }
+  }
+
+  return &net_stats;
+}
+
+//Partitions and virtual devices seen in /proc/diskstats, until a block device comes or goes
+static char skipped_disks[PROC_MAX_SKIPPED_DISKS][PROC_NAMELEN];
+static int n_skipped_disks = 0;
+
+void proc_stats_block_changed(void){
+  n_skipped_disks = 0;
+}
+
+//Only whole disks are listed in /sys/block, with a device. Partitions and virtual devices don't take a slot
+static DiskDevice *disk_device(const char *name){
+  char path[SYSFS_ATTR_PATHLEN];
+  DiskDevice *disk;
+  struct stat st;
+
+  //Loop and ram devices are not worth showing, no need to look them up
+  if (strncmp(name, "loop", 4) == 0 || strncmp(name, "ram", 3) == 0 || strncmp(name, "zram", 4) == 0){
+    return NULL;
+  }
+
+  for (int i = 0; i < disk_stats.ndisks; i++){
+    if (strcmp(disk_stats.disks[i].name, name) == 0){
+      return &disk_stats.disks[i];
+    }
+  }
+  for (int i = 0; i < n_skipped_disks; i++){
+    if (strcmp(skipped_disks[i], name) == 0){
+      return NULL;
+    }
+  }
+  if (disk_stats.ndisks >= PROC_MAX_DISKS){
+    return NULL;
+  }
+
+  snprintf(path, sizeof(path), "%s/block/%s/device", sysfs_root(), name);
+  if (stat(path, &st) != 0){
+    //Looked up once. Past the limit they are just looked up every time
+    if (n_skipped_disks < PROC_MAX_SKIPPED_DISKS){
+      strcpy(skipped_disks[n_skipped_disks++], name);
+    }
+    return NULL;
+  }
+  disk = &disk_stats.disks[disk_stats.ndisks++];
+  memset(disk, 0, sizeof(DiskDevice));
+  strcpy(disk->name, name);
+  return disk;
+}
+
+DiskStats *proc_stats_disk(void){
+  unsigned long long rd, wr;
+  char name[PROC_NAMELEN];
+  DiskDevice *disk;
+  const char *p;
+  double dt;
+
+  if ((dt = elapsed(&disk_time)) < 0 || proc_file_read(&proc_diskstats) < 0){
+    return &disk_stats;
+  }
+
+  disk_stats.read_rate = disk_stats.write_rate = 0;
+
+  //major minor name reads merged sectors_read ms writes merged sectors_written ...
+  for (p = proc_diskstats.buf; *p; p = next_line(p)){
+    parse_ull(&p);
+    parse_ull(&p);
+    parse_name(&p, name, sizeof(name), ' ');
+    if (name[0] == '\0'){
+      continue;
+    }
+
+    if ((disk = disk_device(name)) == NULL){
+      continue;
+    }
+
+    parse_ull(&p);
+    parse_ull(&p);
+    rd = parse_ull(&p);
+    parse_ull(&p);
+    parse_ull(&p);
+    parse_ull(&p);
+    wr = parse_ull(&p);
+
+    //A counter going back means the device was reattached
+    if ((disk->read_sectors != 0 || disk->write_sectors != 0) && rd >= disk->read_sectors && wr >= disk->write_sectors){
+      disk->read_rate  = (rd - disk->read_sectors)  * 512.0 / dt;
+      disk->write_rate = (wr - disk->write_sectors) * 512.0 / dt;
+    } else {
+      disk->read_rate = disk->write_rate = 0;
+    }
+    disk->read_sectors = rd;
+    disk->write_sectors = wr;
+
+    disk_stats.read_rate  += disk->read_rate;
+    disk_stats.write_rate += disk->write_rate;
+  }
+
+  return &disk_stats;
+}
+
+//Picks the first hwmon device in hwmon_names order that has temp1_input
+static void hwmon_discover(void){
+  char path[SYSFS_ATTR_PATHLEN];
+  char temp_path[SYSFS_ATTR_PATHLEN] = "";
+  char folder[SYSFS_ATTR_PATHLEN];
+  char name[PROC_NAMELEN];
+  int best = -1;
+  struct dirent *dir;
+  DIR *d;
+
+  hwmon_discovered = true;
+
+  snprintf(folder, sizeof(folder), "%s/class/hwmon", sysfs_root());
+  if ((d = opendir(folder)) == NULL){
+    return;
+  }
+
+  while ((dir = readdir(d)) != NULL){
+    if (dir->d_name[0] == '.'){
+      continue;
+    }
+    if (snprintf(path, sizeof(path), "%s/%s/name", folder, dir->d_name) >= (int) sizeof(path)){
+      continue;
+    }
+    if (read_file_string(path, name, sizeof(name)) < 0){
+      continue;
+    }
+    name[strcspn(name, "\n")] = '\0';
+
+    for (int i = 0; hwmon_names[i] && (best < 0 || i < best); i++){
+      if (strcmp(name, hwmon_names[i]) == 0){
+        if (snprintf(path, sizeof(path), "%s/%s/temp1_input", folder, dir->d_name) < (int) sizeof(path) && access(path, R_OK) == 0){
+          strcpy(temp_path, path);
+          best = i;
+        }
+        break;
+      }
+    }
+  }
+  closedir(d);
+
+  if (temp_path[0] != '\0'){
+    hwmon_temp = sysfs_attr_get(temp_path);
+  }
+}
+
+int proc_stats_temperature(void){
+  char value[SYSFS_ATTR_VALUELEN];
+  const char *p = value;
+
+  if (!hwmon_discovered){
+    hwmon_discover();
+  }
+  if (hwmon_temp == NULL || sysfs_attr_read(hwmon_temp, value, sizeof(value)) < 0){
+    return -1;
+  }
+
+  return (int) parse_ull(&p);
+}
@@ -0,0 +1,198 @@
+#include <pulse_volume.h>
+#include <event_loop.h>
+#include <bar_modules.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef PULSEAUDIO
+#include <pulse/pulseaudio.h>
+
+#define PULSE_CLIENT_NAME WMNAME
+
+static pa_threaded_mainloop *mainloop = NULL;
+static pa_context *context = NULL;
+
+//Default sink state. Written from the PulseAudio thread, read by the bar
+static pthread_mutex_t mutex_volume = PTHREAD_MUTEX_INITIALIZER;
+static bool sink_known = false;
+static char sink_name[256];
+static pa_cvolume sink_volume;
+static int sink_percent;
+static bool sink_muted;
+
+static void sink_info_callback(pa_context *c, const pa_sink_info *i, int eol, void *userdata){
+  if (eol || i == NULL){
+    return;
+  }
+
+  pthread_mutex_lock(&mutex_volume);
+  snprintf(sink_name, sizeof(sink_name), "%s", i->name);
+  sink_volume = i->volume;
+  sink_percent = (pa_cvolume_avg(&i->volume) * 100 + PA_VOLUME_NORM / 2) / PA_VOLUME_NORM;
+  sink_muted = i->mute;
+  sink_known = true;
+  pthread_mutex_unlock(&mutex_volume);
+
+  request_drawbars_modules(bar_modules_mask(BAR_MODULE_VOLUME));
+}
+
+static void server_info_callback(pa_context *c, const pa_server_info *i, void *userdata){
+  if (i == NULL || i->default_sink_name == NULL){
+    return;
+  }
+  pa_operation_unref(pa_context_get_sink_info_by_name(c, i->default_sink_name, sink_info_callback, NULL));
+}
+
+//Sink changes (volume, mute) and server changes (default sink switched) from any client
+static void subscribe_callback(pa_context *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata){
+  unsigned facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+
+  if (facility == PA_SUBSCRIPTION_EVENT_SINK || facility == PA_SUBSCRIPTION_EVENT_SERVER){
+    pa_operation_unref(pa_context_get_server_info(c, server_info_callback, NULL));
+  }
+}
+
+static void context_state_callback(pa_context *c, void *userdata){
+  switch (pa_context_get_state(c)){
+    case PA_CONTEXT_READY:
+      pa_context_set_subscribe_callback(c, subscribe_callback, NULL);
+      pa_operation_unref(pa_context_subscribe(c, PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SERVER, NULL, NULL));
+      pa_operation_unref(pa_context_get_server_info(c, server_info_callback, NULL));
+      break;
+    case PA_CONTEXT_CONNECTING:
+    case PA_CONTEXT_FAILED:
+    case PA_CONTEXT_TERMINATED:
+      //With PA_CONTEXT_NOFAIL the context reconnects by itself when the server comes back
+      pthread_mutex_lock(&mutex_volume);
+      sink_known = false;
+      pthread_mutex_unlock(&mutex_volume);
+      break;
+    default:
+      break;
+  }
+}
+
+int pulse_volume_init(void){
+  if ((mainloop = pa_threaded_mainloop_new()) == NULL){
+    return -1;
+  }
+
+  context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), PULSE_CLIENT_NAME);
+  if (context == NULL){
+    goto pulse_volume_init_error;
+  }
+  pa_context_set_state_callback(context, context_state_callback, NULL);
+
+  if (pa_context_connect(context, NULL, PA_CONTEXT_NOFAIL, NULL) < 0){
+    goto pulse_volume_init_error;
+  }
+  if (pa_threaded_mainloop_start(mainloop) < 0){
+    goto pulse_volume_init_error;
+  }
+
+  return 0;
+
+  pulse_volume_init_error:
+  if (context){
+    pa_context_unref(context);
+    context = NULL;
+  }
+  pa_threaded_mainloop_free(mainloop);
+  mainloop = NULL;
+  return -1;
+}
+
+bool pulse_volume_get(int *percent, bool *muted){
+  bool known;
+
+  pthread_mutex_lock(&mutex_volume);
+  known = sink_known;
+  *percent = sink_percent;
+  *muted = sink_muted;
+  pthread_mutex_unlock(&mutex_volume);
+
+  return known;
+}
+
+int pulse_volume_change(int delta_percent){
+  pa_volume_t step = (pa_volume_t) (PA_VOLUME_NORM * (delta_percent < 0 ? -delta_percent : delta_percent) / 100);
+  char name[256];
+  pa_cvolume v;
+
+  if (mainloop == NULL){
+    return -1;
+  }
+
+  pthread_mutex_lock(&mutex_volume);
+  if (!sink_known){
+    pthread_mutex_unlock(&mutex_volume);
+    return -1;
+  }
+  v = sink_volume;
+  strcpy(name, sink_name);
+  pthread_mutex_unlock(&mutex_volume);
+
+  if (delta_percent > 0){
+    pa_cvolume_inc_clamp(&v, step, PA_VOLUME_NORM);
+  } else {
+    pa_cvolume_dec(&v, step);
+  }
+
+  //Expected state, shown right away and overwritten when the subscription reports the real one.
+  //Repeated changes build on it, so fast key presses don't get lost
+  pthread_mutex_lock(&mutex_volume);
+  sink_volume = v;
+  sink_percent = (pa_cvolume_avg(&v) * 100 + PA_VOLUME_NORM / 2) / PA_VOLUME_NORM;
+  pthread_mutex_unlock(&mutex_volume);
+
+  //Don't wait for the operation, the subscription reports the new volume
+  pa_threaded_mainloop_lock(mainloop);
+  pa_operation_unref(pa_context_set_sink_volume_by_name(context, name, &v, NULL, NULL));
+  pa_threaded_mainloop_unlock(mainloop);
+
+  return 0;
+}
+
+int pulse_volume_toggle_mute(void){
+  char name[256];
+  bool muted;
+
+  if (mainloop == NULL){
+    return -1;
+  }
+
+  pthread_mutex_lock(&mutex_volume);
+  if (!sink_known){
+    pthread_mutex_unlock(&mutex_volume);
+    return -1;
+  }
+  muted = sink_muted;
+  sink_muted = !muted;        //Expected state, until the subscription reports the real one
+  strcpy(name, sink_name);
+  pthread_mutex_unlock(&mutex_volume);
+
+  pa_threaded_mainloop_lock(mainloop);
+  pa_operation_unref(pa_context_set_sink_mute_by_name(context, name, !muted, NULL, NULL));
+  pa_threaded_mainloop_unlock(mainloop);
+
+  return 0;
+}
+
+#else //PULSEAUDIO
+
+int pulse_volume_init(void){
+  return -1;
+}
+bool pulse_volume_get(int *percent, bool *muted){
+  return false;
+}
+int pulse_volume_change(int delta_percent){
+  return -1;
+}
+int pulse_volume_toggle_mute(void){
+  return -1;
+}
+
+#endif //PULSEAUDIO
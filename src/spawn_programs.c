@@ -1,14 +1,33 @@
+//posix_spawn extensions: POSIX_SPAWN_SETSID, posix_spawn_file_actions_addclosefrom_np
+#define _GNU_SOURCE
+
 #include <horizonwm_type_definitions.h>
 #include <spawn_programs.h>
 #include <util.h>
 #include <global_vars.h>
-
+#include <status_feed.h>
+#include <zygote.h>
+#include <children.h>
+#include <event_loop.h>
+#include <line_filter.h>
+#include <spawn_stats.h>
+
+#include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <signal.h>
+#include <spawn.h>
 #include <sys/wait.h>
 #include <fcntl.h>
 
+//glibc >= 2.34 closes every other descriptor in the child with close_range()
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+#define HAVE_ADDCLOSEFROM
+#endif
+
 const char *browsercmd[]            = { "brave", NULL };
 const char *browser_private_cmd[]   = { "brave", "--incognito",  NULL };
 
@@ -22,21 +41,24 @@ const char *calculatorcmd[]         = {"gnome-calculator", NULL};
 const char *dunstcmd[]              = {"dunst", NULL};
 const char *configkeyboardcmd[]     = {"xset", "r", "rate", "300", "50", NULL };
 const char *wallpapercmd[]          = {WALLPAPERCMD, "bg", NULL};
+const char *statusfeedercmd[]       = {"i3status", NULL};    //Plain text or i3bar JSON blocks, see status_feed.h
 
-//Monitor brightness
-const char *downbrightnesscmd[]     = {"brightnessctl", "s", "5%-", NULL};
-const char *upbrightnesscmd[]       = {"brightnessctl", "s", "5%+", NULL};
+//Monitor brightness. "%d" is replaced by the (coalesced) step in percent
+const char *downbrightnesscmd[]     = {"brightnessctl", "s", "%d%%-", NULL};
+const char *upbrightnesscmd[]       = {"brightnessctl", "s", "%d%%+", NULL};
 const char *monitoroffcmd[]         = {"xset", "dpms", "force", "off", NULL};
 
-//Volume
-const char *upvolumecmd[]           = {"pamixer", "-i", "5", NULL};
-const char *downvolume[]            = {"pamixer", "-d", "5", NULL};
+//Volume. "%d" is replaced by the (coalesced) step in percent
+const char *upvolumecmd[]           = {"pamixer", "-i", "%d", NULL};
+const char *downvolume[]            = {"pamixer", "-d", "%d", NULL};
 const char *mutevolume[]            = {"pamixer", "-t", NULL};
+const char *getvolumecmd[]          = {"pamixer", "--get-volume", NULL};
+const char *getmutecmd[]            = {"pamixer", "--get-mute", NULL};
 
 //System commands
 const char *poweroffcmd[]           = {"poweroff", NULL};
 const char *rebootcmd[]             = {"reboot", NULL};
-const char *lockscreencmd[]         = {"i3lock", "-f", "-e", NULL};
+const char *lockscreencmd[]         = {"i3lock", "-n", "-f", "-e", NULL};   //-n: no fork, its pid tells the screen is locked
 const char *updatearchlinuxcmd[]    = {"alacritty", "-e", "yay", "-Syu", NULL};
 const char *sysctl_status_ovpn[]    = {"systemctl", "is-active", "openvpn-client@*", NULL};
 const char *sysctl_start_ovpn[]     = {"sudo", "systemctl", "start", "openvpn-client@client", NULL};
@@ -51,6 +73,7 @@ const char *mpc_stop[]              = {"mpc", "-q", "stop",         NULL};
 const char *mpc_next[]              = {"mpc", "-q", "next",         NULL};
 const char *mpc_volumeup[]          = {"mpc", "-q", "volume", "+5", NULL};
 const char *mpc_volumedown[]        = {"mpc", "-q", "volume", "-5", NULL};
+const char *mpc_status[]            = {"mpc", "status", NULL};
 
 //Keyboard brightness
 const char *KBdownbrightnesscmd[]   = {"brightnessctl", "-q", "-d='asus::kbd_backlight'", "s", "1-", NULL};
@@ -62,188 +85,278 @@ ProgramService startup_programs[] = {
   {wallpapercmd,      0, 0},
   {dunstcmd,          0, 0},
   {configkeyboardcmd, 0, 0},
+  //{statusfeedercmd, PROGRAM_STATUS_FEEDER, 0},   //Long lived program writing bar blocks to stdout
   {0, 0, 0}
 };
 
-unsigned int spawn_pid (const Arg *arg){
-  int pid;
-  if ((pid = fork()) == 0) {
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
+pid_t spawn_launch_local(const char *const argv[], int in, int out, int err){
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  const int fds[3] = {in, out, err};
+  short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+  sigset_t none, pipe;
+  pid_t pid;
+  int e;
+
+  posix_spawn_file_actions_init(&actions);
+  for (int i = 0; i < 3; i++){
+    if (fds[i] == SPAWN_DEVNULL){
+      posix_spawn_file_actions_addopen(&actions, i, "/dev/null", i == 0 ? O_RDONLY : O_WRONLY, 0);
+    } else if (fds[i] >= 0){
+      posix_spawn_file_actions_adddup2(&actions, fds[i], i);
+    }
+  }
+#ifdef HAVE_ADDCLOSEFROM
+  //Only stdin, stdout and stderr reach the child. Not the X connection, sysfs, pipes of other children...
+  posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+#else
+  if (dpy){
+    posix_spawn_file_actions_addclose(&actions, ConnectionNumber(dpy));
+  }
+#endif
+
+  //The calling thread may have signals blocked, the program shouldn't
+  posix_spawnattr_init(&attr);
+  sigemptyset(&none);
+  posix_spawnattr_setsigmask(&attr, &none);
+  //Nor SIGPIPE ignored, as the WM and the launcher have it
+  sigemptyset(&pipe);
+  sigaddset(&pipe, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &pipe);
+#ifdef POSIX_SPAWN_SETSID
+  flags |= POSIX_SPAWN_SETSID;
+#endif
+  posix_spawnattr_setflags(&attr, flags);
+
+  //glibc uses clone(CLONE_VM | CLONE_VFORK): no page tables are copied, whatever the WM size
+  e = posix_spawnp(&pid, argv[0], &actions, &attr, (char *const *) argv, environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+
+  if (e != 0){
+    fprintf(stderr, "horizonwm: spawn '%s' failed: %s\n", argv[0], strerror(e));
+    errno = e;
+    return -1;
   }
+  return pid;
+}
 
+pid_t spawn_launch(const char *const argv[], int in, int out, int err){
+  SpawnStatsRun run;
+  pid_t pid;
+
+  spawn_stats_start(&run, argv[0]);
+  pid = zygote_spawn(argv, in, out, err, NULL);
+  if (pid == ZYGOTE_DOWN){
+    pid = spawn_launch_local(argv, in, out, err);
+  }
+  //Nobody waits for it, so it is only counted
+  if (pid > 0){
+    spawn_stats_end(&run, NULL);
+  }
   return pid;
 }
 
-void spawn (const Arg *arg){
-  if (fork() == 0) {
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
+//Launched, to be waited for with spawn_finish(). status_fd is -1 if it was started here
+static pid_t spawn_start(const char *const argv[], int in, int out, int err, int *status_fd, SpawnStatsRun *run){
+  pid_t pid;
+
+  spawn_stats_start(run, argv[0]);
+  pid = zygote_spawn(argv, in, out, err, status_fd);
+  if (pid == ZYGOTE_DOWN){
+    *status_fd = -1;
+    pid = spawn_launch_local(argv, in, out, err);
   }
+  return pid;
 }
 
-void spawn_waitpid (const Arg *arg){
-  int pid;
-  if ((pid = fork() == 0)) {
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
+//Waits for it, and accounts what it cost to run. Returns its wait status, or -1
+static int spawn_finish(pid_t pid, int status_fd, const SpawnStatsRun *run){
+  ChildUsage usage;
+  int status;
+
+  if (pid <= 0){
+    return -1;
+  }
+  if (status_fd >= 0){
+    status = zygote_wait(status_fd, &usage);
+  } else {
+    //Started here, our child: reaped by the main loop, which hands it over
+    status = children_wait(pid, &usage);
   }
+  spawn_stats_end(run, status < 0 ? NULL : &usage);
+  return status;
+}
+
+int spawn_launch_wait(const char *const argv[], int in, int out, int err){
+  SpawnStatsRun run;
+  int status_fd;
+  pid_t pid = spawn_start(argv, in, out, err, &status_fd, &run);
 
-  waitpid(pid, NULL, 0);
+  return spawn_finish(pid, status_fd, &run);
 }
-int spawn_retval(const Arg *arg){
-  int pid, retval = 0;
-  if ((pid = fork() == 0)){
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
-  }
 
-  waitpid(pid, &retval, 0);
-  return retval;
+//Both ends close on exec, so only the child they are given to (as stdin/stdout) gets them
+static void spawn_pipe_create(int p[2], const Arg *arg){
+  if (pipe(p) < 0){
+    die("horizonwm: pipe failed on spawn(%s)", ((char **)arg->v)[0]);
+  }
+  fcntl(p[0], F_SETFD, FD_CLOEXEC);
+  fcntl(p[1], F_SETFD, FD_CLOEXEC);
 }
 
-void spawn_devnull(const Arg *arg){
-  if (fork() == 0) {
-    close(1);
-    open("/dev/null", O_WRONLY);
-
-    close(2);
-    dup(0);
-
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
+static void read_output(int fd, char *buffer, size_t size){
+  ssize_t n = read(fd, buffer, size);
+  if (n >= 0 && n < size){
+    buffer[n] = '\0';
   }
+  close(fd);
 }
 
-void spawn_catchoutput (const Arg *arg, char *buffer, size_t size){
+unsigned int spawn_pid (const Arg *arg){
+  pid_t pid = spawn_launch(arg->v, SPAWN_INHERIT, SPAWN_INHERIT, SPAWN_INHERIT);
+  return pid < 0 ? 0 : pid;
+}
+
+void spawn (const Arg *arg){
+  spawn_launch(arg->v, SPAWN_INHERIT, SPAWN_INHERIT, SPAWN_INHERIT);
+}
+
+void spawn_waitpid (const Arg *arg){
+  spawn_launch_wait(arg->v, SPAWN_INHERIT, SPAWN_INHERIT, SPAWN_INHERIT);
+}
+int spawn_retval(const Arg *arg){
+  int retval = spawn_launch_wait(arg->v, SPAWN_INHERIT, SPAWN_INHERIT, SPAWN_INHERIT);
+  return retval < 0 ? 0 : retval;
+}
+
+unsigned int spawn_pipe(const Arg *arg, int *fd){
+  pid_t pid;
   int p[2];
-  if (pipe(p) < 0){
-    die("horizonwm: pipe failed on spawn_catchoutput(%s)", ((char **)arg->v)[0]);
-  }
 
-  if (fork() == 0) {
-    close(1); dup(p[1]); close(p[1]); close(p[0]);  //Redirect stdout to pipe
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
-  }
+  spawn_pipe_create(p, arg);
+  pid = spawn_launch(arg->v, SPAWN_INHERIT, p[1], SPAWN_INHERIT);
   close(p[1]);
-  read(p[0], buffer, size);
-  close(p[0]);
+  *fd = p[0];
 
-  return;
+  return pid < 0 ? 0 : pid;
 }
 
-void spawn_greppattern(const Arg *arg, const char *flags, const char *pattern, char *buffer, size_t bufsize){
-  int p_arg_grep[2];
-  int p_grep_main[2];
+void spawn_devnull(const Arg *arg){
+  spawn_launch(arg->v, SPAWN_INHERIT, SPAWN_DEVNULL, SPAWN_DEVNULL);
+}
 
-  if (pipe(p_arg_grep) < 0){
-    die("horizonwm: pipe failed on spawn_greppattern(%s, %s)", ((char **)arg->v)[0], pattern);
-  }
+void spawn_catchoutput (const Arg *arg, char *buffer, size_t size){
+  SpawnStatsRun run;
+  int p[2], status_fd;
+  pid_t pid;
 
-  if (fork() == 0){
-    close(1); dup(p_arg_grep[1]); close(p_arg_grep[1]); close(p_arg_grep[0]);
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
+  spawn_pipe_create(p, arg);
+  pid = spawn_start(arg->v, SPAWN_INHERIT, p[1], SPAWN_INHERIT, &status_fd, &run);
+  close(p[1]);
+  read_output(p[0], buffer, size);
+  spawn_finish(pid, status_fd, &run);
+}
+
+int spawn_capture(const char *const argv[], char *buffer, size_t size){
+  SpawnStatsRun run;
+  int p[2], status_fd;
+  size_t len = 0;
+  char discard[512];
+  ssize_t n;
+  pid_t pid;
+
+  if (pipe(p) < 0){
+    return -1;
   }
-  close(p_arg_grep[1]);
+  fcntl(p[0], F_SETFD, FD_CLOEXEC);
+  fcntl(p[1], F_SETFD, FD_CLOEXEC);
+  pid = spawn_start(argv, SPAWN_INHERIT, p[1], SPAWN_INHERIT, &status_fd, &run);
+  close(p[1]);
 
-  if (pipe(p_grep_main) < 0){
-    die("horizonwm: pipe failed on spawn_greppattern(%s, %s)", ((char **)arg->v)[0], pattern);
+  //All of it is read before waiting, or a chatty program would never exit
+  for (;;){
+    n = len + 1 < size ? read(p[0], buffer + len, size - 1 - len) : read(p[0], discard, sizeof(discard));
+    if (n > 0 && len + 1 < size){
+      len += n;
+    } else if (n == 0 || (n < 0 && errno != EINTR)){
+      break;
+    }
+  }
+  close(p[0]);
+  if (size > 0){
+    buffer[len] = '\0';
   }
 
-  if (fork() == 0){
-    close(0); dup(p_arg_grep[0]); close(p_arg_grep[1]); close(p_arg_grep[0]);
-    close(1); dup(p_grep_main[1]); close(p_grep_main[1]); close(p_grep_main[0]);
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    if (flags != NULL){
-      execlp("grep", "grep", flags, pattern, NULL);
-    } else {
-      execlp("grep", "grep", pattern, NULL);
+  return spawn_finish(pid, status_fd, &run);
+}
+
+//Output goes through f as it is read: one process, no grep or wc behind it
+static void spawn_filter(const Arg *arg, LineFilter *f){
+  SpawnStatsRun run;
+  char chunk[4096];
+  int p[2], status_fd;
+  ssize_t n;
+  pid_t pid;
+
+  spawn_pipe_create(p, arg);
+  pid = spawn_start(arg->v, SPAWN_INHERIT, p[1], SPAWN_INHERIT, &status_fd, &run);
+  close(p[1]);
+
+  while ((n = read(p[0], chunk, sizeof(chunk))) > 0 || (n < 0 && errno == EINTR)){
+    if (n > 0){
+      line_filter_feed(f, chunk, n);
     }
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
   }
-  close(p_grep_main[1]); close(p_arg_grep[0]);
+  line_filter_end(f);
+  close(p[0]);
+  spawn_finish(pid, status_fd, &run);
+}
 
-  read(p_grep_main[0], buffer, bufsize);
-  close(p_grep_main[0]);
+int spawn_greppattern(const Arg *arg, const char *pattern, char *buffer, size_t bufsize){
+  LineFilter f;
+
+  line_filter_init(&f, pattern, 0, buffer, bufsize);
+  spawn_filter(arg, &f);
+  return f.matches;
 }
 
 int spawn_readint(const Arg *arg){
-  int p[2];
+  SpawnStatsRun run;
   char buffer[32];
-  if (pipe(p) < 0){
-    die("horizonwm: pipe failed on spawn_catchoutput(%s)", ((char **)arg->v)[0]);
-  }
+  int p[2], status_fd;
+  pid_t pid;
 
-  if (fork() == 0) {
-    close(1); dup(p[1]); close(p[1]); close(p[0]);  //Redirect stdout to pipe
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
-  }
+  buffer[0] = '\0';
+  spawn_pipe_create(p, arg);
+  pid = spawn_start(arg->v, SPAWN_INHERIT, p[1], SPAWN_INHERIT, &status_fd, &run);
   close(p[1]);
-  read(p[0], buffer, 31);
-  close(p[0]);
+  read_output(p[0], buffer, 31);
+  spawn_finish(pid, status_fd, &run);
 
   return atoi(buffer);
 }
 
 int spawn_readint_feedstdin(const Arg *arg, const char *s){
+  SpawnStatsRun run;
   int p_in[2];
   int p_out[2];
+  int status_fd;
   char buffer[32];
+  pid_t pid;
   buffer[0] = '\0';
 
-  if (pipe(p_in) < 0){
-    die("horizonwm: pipe failed on spawn_catchoutput(%s)", ((char **)arg->v)[0]);
-  }
-  if (pipe(p_out) < 0){
-    die("horizonwm: pipe failed on spawn_catchoutput(%s)", ((char **)arg->v)[0]);
-  }
-
-  if (fork() == 0){
-    close(0); dup(p_in[0]); close(p_in[1]); close(p_in[0]);
-    close(1); dup(p_out[1]);close(p_out[0]);close(p_out[1]);
-
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
-  }
+  spawn_pipe_create(p_in, arg);
+  spawn_pipe_create(p_out, arg);
+  pid = spawn_start(arg->v, p_in[0], p_out[1], SPAWN_INHERIT, &status_fd, &run);
   close(p_in[0]); close(p_out[1]);
 
   write(p_in[1], s, strlen(s));
   close(p_in[1]);
 
-  read(p_out[0], buffer, 31);
-  close(p_out[0]);
+  read_output(p_out[0], buffer, 31);
+  spawn_finish(pid, status_fd, &run);
 
   if (strlen(buffer) == 0){
     return -1;
@@ -253,37 +366,208 @@ int spawn_readint_feedstdin(const Arg *arg, const char *s){
 }
 
 int spawn_countlines (const Arg *arg){
-  int p[2];
-  int p2[2];
-  char buffer[32];
+  LineFilter f;
+
+  line_filter_init(&f, NULL, 0, NULL, 0);
+  spawn_filter(arg, &f);
+  return f.lines;
+}
+
+//ASYNCHRONOUS
+struct SpawnJob {
+  bool used;
+  pid_t pid;
+  int out_fd;                         //-1 once at EOF, or if not captured
+  int in_fd;                          //-1 once everything is written
+  int exit_fd;                        //Launcher status pipe, -1 if started here or once read
+  bool exited;
+  int status;
+  ChildUsage usage;
+  SpawnStatsRun run;
+  char *input;
+  size_t input_len, input_written;
+  char output[SPAWN_ASYNC_MAX_OUTPUT];
+  size_t output_len;
+  SpawnDone done;
+  void *data;
+};
+
+static SpawnJob jobs[SPAWN_ASYNC_MAX_JOBS];
+
+static void spawn_async_close(int *fd){
+  if (*fd >= 0){
+    event_loop_unwatch(*fd);
+    close(*fd);
+    *fd = -1;
+  }
+}
+
+static void spawn_async_finish(SpawnJob *job){
+  const char *tag;
+
+  if (job->out_fd >= 0 || !job->exited){
+    return;
+  }
+  spawn_async_close(&job->in_fd);
+  free(job->input);
+  job->input = NULL;
+
+  spawn_stats_end(&job->run, job->status < 0 ? NULL : &job->usage);
+
+  //The slot stays taken during the callback, which may start other jobs. They are accounted to this one's tag
+  if (job->done){
+    tag = spawn_stats_set_tag(job->run.tag);
+    job->done(job->status, job->output, job->data);
+    spawn_stats_set_tag(tag);
+  }
+  job->used = false;
+}
+
+static void spawn_async_output(int fd, short revents, void *data){
+  SpawnJob *job = (SpawnJob *) data;
+  char discard[512];
+  size_t room = sizeof(job->output) - 1 - job->output_len;
+  ssize_t n;
+
+  n = room > 0 ? read(fd, job->output + job->output_len, room) : read(fd, discard, sizeof(discard));
+  if (n > 0){
+    if (room > 0){
+      job->output_len += n;
+      job->output[job->output_len] = '\0';
+    }
+    return;
+  }
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)){
+    return;
+  }
+  spawn_async_close(&job->out_fd);
+  spawn_async_finish(job);
+}
+
+static void spawn_async_input(int fd, short revents, void *data){
+  SpawnJob *job = (SpawnJob *) data;
+  ssize_t n;
+
+  if (!(revents & (POLLERR | POLLHUP))){
+    n = write(fd, job->input + job->input_written, job->input_len - job->input_written);
+    if (n > 0){
+      job->input_written += n;
+    }
+    if ((n > 0 && job->input_written < job->input_len) || (n < 0 && errno == EAGAIN)){
+      return;
+    }
+  }
+  //All written, or the program doesn't read it: it gets EOF
+  spawn_async_close(&job->in_fd);
+}
+
+static void spawn_async_exited(SpawnJob *job, int status){
+  job->exited = true;
+  job->status = status;
+  spawn_async_close(&job->in_fd);
+  spawn_async_finish(job);
+}
+
+//Launched by the launcher: its status pipe became readable
+static void spawn_async_exit(int fd, short revents, void *data){
+  SpawnJob *job = (SpawnJob *) data;
+
+  event_loop_unwatch(fd);
+  job->exit_fd = -1;
+  spawn_async_exited(job, zygote_wait(fd, &job->usage));   //Readable: doesn't block
+}
+
+//Launched here: reaped by the main loop
+static void spawn_async_child_exited(pid_t pid, int status, const ChildUsage *usage, void *data){
+  SpawnJob *job = (SpawnJob *) data;
+
+  job->usage = *usage;
+  spawn_async_exited(job, status);
+}
+
+static int spawn_async_pipe(int p[2]){
   if (pipe(p) < 0){
-    die("horizonwm: pipe failed on spawn_catchoutput(%s)", ((char **)arg->v)[0]);
+    return -1;
   }
-  if (fork() == 0) {
-    close(1); dup(p[1]); close(p[1]); close(p[0]);  //Redirect stdout to pipe
-    if (dpy)
-      close(ConnectionNumber(dpy));
-    setsid();
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    die("horizonwm: execvp '%s' failed:", ((char **)arg->v)[0]);
+  for (int i = 0; i < 2; i++){
+    fcntl(p[i], F_SETFD, FD_CLOEXEC);
   }
+  return 0;
+}
+
+SpawnJob *spawn_async(const char *const argv[], const char *input, bool capture, SpawnDone done, void *data){
+  int in[2] = {-1, -1}, out[2] = {-1, -1};
+  SpawnJob *job = NULL;
 
-  if (pipe(p2) < 0){
-    die("horizonwm: pipe failed on spawn_catchoutput(%s)", ((char **)arg->v)[0]);
+  for (int i = 0; i < SPAWN_ASYNC_MAX_JOBS; i++){
+    if (!jobs[i].used){
+      job = &jobs[i];
+      break;
+    }
+  }
+  if (job == NULL
+  || (input != NULL && spawn_async_pipe(in) < 0)
+  || (capture && spawn_async_pipe(out) < 0)){
+    fprintf(stderr, "horizonwm: can't run '%s' in the background\n", argv[0]);
+    close(in[0]); close(in[1]);
+    return NULL;
   }
 
-  if (fork() == 0){
-    close(0); dup(p[0]); close(p[1]); close(p[0]);
-    close(1); dup(p2[1]); close(p2[1]); close(p2[0]);
-    execlp("wc", "wc", "-l", NULL);
-    die("horizonwm: execlp 'wc -l' failed:");
+  memset(job, 0, offsetof(SpawnJob, output));
+  job->output[0] = '\0';
+  job->output_len = 0;
+  job->status = -1;
+  job->done = done;
+  job->data = data;
+
+  job->pid = spawn_start(argv, in[0], capture ? out[1] : SPAWN_INHERIT, SPAWN_INHERIT, &job->exit_fd, &job->run);
+  if (in[0] >= 0) close(in[0]);
+  if (out[1] >= 0) close(out[1]);
+  job->in_fd = in[1];
+  job->out_fd = out[0];
+
+  if (job->pid <= 0){
+    job->exit_fd = -1;
+    spawn_async_close(&job->in_fd);
+    spawn_async_close(&job->out_fd);
+    return NULL;
   }
-  close(p[1]); close(p[1]);
-  close(p2[1]);
-  read(p2[0], buffer, 31);
-  close(p2[0]);
 
-  return atoi(buffer);
+  job->used = true;
+  if (job->in_fd >= 0){
+    job->input_len = strlen(input);
+    if ((job->input = strdup(input)) == NULL){
+      job->input_len = 0;
+    }
+    fcntl(job->in_fd, F_SETFL, O_NONBLOCK);
+    if (event_loop_watch(job->in_fd, POLLOUT, spawn_async_input, job) < 0){
+      close(job->in_fd);
+      job->in_fd = -1;
+    }
+  }
+  if (job->out_fd >= 0){
+    fcntl(job->out_fd, F_SETFL, O_NONBLOCK);
+    if (event_loop_watch(job->out_fd, POLLIN, spawn_async_output, job) < 0){
+      close(job->out_fd);
+      job->out_fd = -1;
+    }
+  }
+  //If the exit can't be followed, done() comes with the output, status unknown
+  if (job->exit_fd >= 0){
+    if (event_loop_watch(job->exit_fd, POLLIN, spawn_async_exit, job) < 0){
+      close(job->exit_fd);
+      job->exit_fd = -1;
+      job->exited = true;
+    }
+  } else if (children_watch(job->pid, spawn_async_child_exited, job) < 0){
+    job->exited = true;
+  }
+
+  if (job->out_fd < 0 && job->exited){
+    //Nothing left to wait for. It did start, so done() is called right away, and the handle is already invalid
+    spawn_async_finish(job);
+  }
+  return job;
 }
 
 void spawn_programs_list(ProgramService *l){
@@ -292,12 +576,22 @@ void spawn_programs_list(ProgramService *l){
   const char **program_cmd = p.cmd;
   Arg a;
   int pid;
+  int fd;
+  const char *tag = spawn_stats_set_tag("startup");
   while (program_cmd != NULL){
     a.v = program_cmd;
-    pid = spawn_pid(&a);
+    if (p.flags & PROGRAM_STATUS_FEEDER){
+      pid = spawn_pipe(&a, &fd);
+      if (status_feed_add(fd, pid) < 0){
+        close(fd);
+      }
+    } else {
+      pid = spawn_pid(&a);
+    }
     l[i].pid = pid;
     i++;
     p = l[i];
     program_cmd = p.cmd;
   }
+  spawn_stats_set_tag(tag);
 }
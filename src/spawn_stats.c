@@ -0,0 +1,197 @@
+#include <spawn_stats.h>
+#include <event_loop.h>
+#include <bar_modules.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/signalfd.h>
+
+typedef struct SpawnStatsEntry {
+  const char *tag;                        //NULL: free
+  char program[SPAWN_STATS_PROGRAM_LEN];
+  unsigned long runs;
+  unsigned long waited;                   //Runs whose usage is known
+  long long wall_us;
+  long long utime_us;
+  long long stime_us;
+  long maxrss_kb;
+} SpawnStatsEntry;
+
+static SpawnStatsEntry entries[SPAWN_STATS_MAX_ENTRIES];
+static pthread_mutex_t mutex_spawn_stats = PTHREAD_MUTEX_INITIALIZER;
+static long long started_us = 0;
+static _Thread_local const char *current_tag = SPAWN_STATS_OTHER;
+
+static long long spawn_stats_now(void){
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+const char *spawn_stats_tag(void){
+  return current_tag;
+}
+
+const char *spawn_stats_set_tag(const char *tag){
+  const char *previous = current_tag;
+
+  current_tag = tag != NULL ? tag : SPAWN_STATS_OTHER;
+  return previous;
+}
+
+void spawn_stats_start(SpawnStatsRun *run, const char *program){
+  const char *name = strrchr(program, '/');
+
+  //Just the name: wallpapercmd is a full path
+  name = name != NULL && name[1] != '\0' ? name + 1 : program;
+  run->tag = current_tag;
+  strncpy(run->program, name, sizeof(run->program) - 1);
+  run->program[sizeof(run->program) - 1] = '\0';
+  run->start_us = spawn_stats_now();
+}
+
+//Called with mutex_spawn_stats locked
+static SpawnStatsEntry *spawn_stats_entry(const char *tag, const char *program){
+  SpawnStatsEntry *e, *last = &entries[SPAWN_STATS_MAX_ENTRIES - 1];
+
+  for (e = entries; e < last && e->tag != NULL; e++){
+    if (strcmp(e->tag, tag) == 0 && strcmp(e->program, program) == 0){
+      return e;
+    }
+  }
+  if (e < last){
+    e->tag = tag;
+    strcpy(e->program, program);
+    return e;
+  }
+  //Full, the last one takes everything else
+  if (last->tag == NULL){
+    last->tag = SPAWN_STATS_OTHER;
+    strcpy(last->program, "*");
+  }
+  return last;
+}
+
+void spawn_stats_end(const SpawnStatsRun *run, const ChildUsage *usage){
+  long long wall_us = spawn_stats_now() - run->start_us;
+  SpawnStatsEntry *e;
+
+  pthread_mutex_lock(&mutex_spawn_stats);
+  e = spawn_stats_entry(run->tag, run->program);
+  e->runs++;
+  if (usage){
+    e->waited++;
+    e->wall_us += wall_us;
+    e->utime_us += usage->utime_us;
+    e->stime_us += usage->stime_us;
+    if (usage->maxrss_kb > e->maxrss_kb){
+      e->maxrss_kb = usage->maxrss_kb;
+    }
+  }
+  pthread_mutex_unlock(&mutex_spawn_stats);
+}
+
+static int spawn_stats_compare(const void *a, const void *b){
+  const SpawnStatsEntry *x = a, *y = b;
+  long long cx = x->utime_us + x->stime_us, cy = y->utime_us + y->stime_us;
+
+  if (cx != cy){
+    return cx < cy ? 1 : -1;
+  }
+  return x->runs < y->runs ? 1 : x->runs > y->runs ? -1 : 0;
+}
+
+static void spawn_stats_print(FILE *f, const SpawnStatsEntry *e, const char *tag, double minutes, double uptime_us){
+  fprintf(f, "%-16s %-16s %8lu %8.2f %8lu %10.1f %8.1f %10.1f %10.1f %7.3f %9ld\n",
+      tag, e->program, e->runs, e->runs / minutes, e->waited,
+      e->wall_us / 1e3, e->waited ? e->wall_us / 1e3 / e->waited : 0.0,
+      e->utime_us / 1e3, e->stime_us / 1e3,
+      100.0 * (e->utime_us + e->stime_us) / uptime_us, e->maxrss_kb);
+}
+
+void spawn_stats_dump(FILE *f){
+  SpawnStatsEntry sorted[SPAWN_STATS_MAX_ENTRIES], total;
+  double minutes, uptime_us;
+  int n;
+
+  pthread_mutex_lock(&mutex_spawn_stats);
+  for (n = 0; n < SPAWN_STATS_MAX_ENTRIES && entries[n].tag != NULL; n++){
+    sorted[n] = entries[n];
+  }
+  pthread_mutex_unlock(&mutex_spawn_stats);
+  qsort(sorted, n, sizeof(SpawnStatsEntry), spawn_stats_compare);
+
+  //Rates over the time the WM has been running
+  uptime_us = spawn_stats_now() - started_us;
+  minutes = uptime_us > 60e6 ? uptime_us / 60e6 : 1;
+
+  fprintf(f, "horizonwm: programs spawned in the last %.0f s\n", uptime_us / 1e6);
+  fprintf(f, "%-16s %-16s %8s %8s %8s %10s %8s %10s %10s %7s %9s\n",
+      "tag", "program", "runs", "runs/min", "waited", "wall ms", "avg ms", "user ms", "sys ms", "cpu %", "rss kB");
+
+  memset(&total, 0, sizeof(total));
+  for (int i = 0; i < n; i++){
+    spawn_stats_print(f, &sorted[i], sorted[i].tag, minutes, uptime_us);
+    total.runs += sorted[i].runs;
+    total.waited += sorted[i].waited;
+    total.wall_us += sorted[i].wall_us;
+    total.utime_us += sorted[i].utime_us;
+    total.stime_us += sorted[i].stime_us;
+    if (sorted[i].maxrss_kb > total.maxrss_kb){
+      total.maxrss_kb = sorted[i].maxrss_kb;
+    }
+  }
+  fprintf(f, "\n");
+  spawn_stats_print(f, &total, "total", minutes, uptime_us);
+  fprintf(f, "\nbar modules painted %lu, left untouched %lu\n", bar_module_repaints, bar_module_repaints_skipped);
+}
+
+static void spawn_stats_signal(int fd, short revents, void *data){
+  struct signalfd_siginfo si;
+  const char *dir = getenv("XDG_RUNTIME_DIR");
+  char path[512];
+  FILE *f = NULL;
+  int file;
+
+  while (read(fd, &si, sizeof(si)) > 0);
+
+  //Only in our own runtime dir, never through a symlink someone else left there
+  if (dir != NULL && dir[0] != '\0'){
+    snprintf(path, sizeof(path), "%s/%s", dir, SPAWN_STATS_FILE);
+    if ((file = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600)) >= 0
+    && (f = fdopen(file, "w")) == NULL){
+      close(file);
+    }
+  }
+  if (f == NULL){
+    spawn_stats_dump(stderr);
+    return;
+  }
+  spawn_stats_dump(f);
+  fclose(f);
+  fprintf(stderr, "horizonwm: statistics written to %s\n", path);
+}
+
+void spawn_stats_init(void){
+  sigset_t usr1;
+  int fd;
+
+  started_us = spawn_stats_now();
+
+  //Blocked here, every thread created later inherits it. Programs are spawned with an empty mask
+  sigemptyset(&usr1);
+  sigaddset(&usr1, SIGUSR1);
+  if (sigprocmask(SIG_BLOCK, &usr1, NULL) < 0
+  || (fd = signalfd(-1, &usr1, SFD_NONBLOCK | SFD_CLOEXEC)) < 0){
+    return;
+  }
+  if (event_loop_watch(fd, POLLIN, spawn_stats_signal, NULL) < 0){
+    close(fd);
+  }
+}
@@ -0,0 +1,350 @@
+#include <status_feed.h>
+#include <event_loop.h>
+#include <bar_modules.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static StatusFeeder feeders[STATUS_FEED_MAX_FEEDERS];
+static int n_feeders = 0;
+
+//JSON. Only what the i3bar protocol needs: flat objects with string values, anything else skipped
+static const char *json_ws(const char *p){
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'){
+    p++;
+  }
+  return p;
+}
+
+static int utf8_encode(unsigned int c, char *out){
+  if (c < 0x80){
+    out[0] = c;
+    return 1;
+  } else if (c < 0x800){
+    out[0] = 0xc0 | (c >> 6);
+    out[1] = 0x80 | (c & 0x3f);
+    return 2;
+  } else if (c < 0x10000){
+    out[0] = 0xe0 | (c >> 12);
+    out[1] = 0x80 | ((c >> 6) & 0x3f);
+    out[2] = 0x80 | (c & 0x3f);
+    return 3;
+  }
+  out[0] = 0xf0 | (c >> 18);
+  out[1] = 0x80 | ((c >> 12) & 0x3f);
+  out[2] = 0x80 | ((c >> 6) & 0x3f);
+  out[3] = 0x80 | (c & 0x3f);
+  return 4;
+}
+
+static unsigned int json_hex4(const char *p){
+  unsigned int v = 0;
+  for (int i = 0; i < 4; i++){
+    v <<= 4;
+    if (p[i] >= '0' && p[i] <= '9')      v |= p[i] - '0';
+    else if (p[i] >= 'a' && p[i] <= 'f') v |= p[i] - 'a' + 10;
+    else if (p[i] >= 'A' && p[i] <= 'F') v |= p[i] - 'A' + 10;
+    else return 0xfffd;
+  }
+  return v;
+}
+
+//p points to the opening quote. Copies (truncating) into out if not NULL. Returns pointer after the closing quote
+static const char *json_string(const char *p, char *out, int size){
+  char utf8[4];
+  unsigned int c;
+  int len = 0, n;
+
+  if (*p++ != '"'){
+    return NULL;
+  }
+  while (*p && *p != '"'){
+    if (*p == '\\'){
+      p++;
+      switch (*p){
+        case 'n': utf8[0] = '\n'; n = 1; break;
+        case 't': utf8[0] = '\t'; n = 1; break;
+        case 'r': utf8[0] = '\r'; n = 1; break;
+        case 'b': utf8[0] = '\b'; n = 1; break;
+        case 'f': utf8[0] = '\f'; n = 1; break;
+        case 'u':
+          if (strnlen(p + 1, 4) < 4){
+            return NULL;
+          }
+          c = json_hex4(p + 1);
+          p += 4;
+          //Surrogate pair
+          if (c >= 0xd800 && c < 0xdc00 && p[1] == '\\' && p[2] == 'u' && strnlen(p + 3, 4) == 4){
+            c = 0x10000 + ((c - 0xd800) << 10) + (json_hex4(p + 3) - 0xdc00);
+            p += 6;
+          }
+          n = utf8_encode(c, utf8);
+          break;
+        case '\0':
+          return NULL;
+        default:  utf8[0] = *p; n = 1; break;
+      }
+      p++;
+    } else {
+      utf8[0] = *p++;
+      n = 1;
+    }
+    if (out && len + n < size){
+      memcpy(out + len, utf8, n);
+      len += n;
+    }
+  }
+  if (*p != '"'){
+    return NULL;
+  }
+  if (out){
+    out[len] = '\0';
+  }
+  return p + 1;
+}
+
+//Numbers, literals, nested objects and arrays
+static const char *json_skip(const char *p){
+  int depth = 0;
+
+  do {
+    if (*p == '"'){
+      if ((p = json_string(p, NULL, 0)) == NULL){
+        return NULL;
+      }
+      continue;
+    }
+    if (*p == '{' || *p == '['){
+      depth++;
+    } else if (*p == '}' || *p == ']'){
+      if (depth == 0){
+        return p;
+      }
+      depth--;
+    } else if (*p == ',' && depth == 0){
+      return p;
+    } else if (*p == '\0'){
+      return NULL;
+    }
+    p++;
+  } while (depth > 0 || (*p != ',' && *p != '}' && *p != ']'));
+
+  return p;
+}
+
+static const char *json_object(const char *p, StatusSegment *s){
+  char key[16];
+
+  memset(s, 0, sizeof(StatusSegment));
+  if (*p++ != '{'){
+    return NULL;
+  }
+  for (p = json_ws(p); *p != '}'; p = json_ws(p)){
+    if ((p = json_string(p, key, sizeof(key))) == NULL){
+      return NULL;
+    }
+    p = json_ws(p);
+    if (*p++ != ':'){
+      return NULL;
+    }
+    p = json_ws(p);
+
+    if (*p == '"' && strcmp(key, "full_text") == 0){
+      p = json_string(p, s->text, sizeof(s->text));
+    } else if (*p == '"' && strcmp(key, "name") == 0){
+      p = json_string(p, s->name, sizeof(s->name));
+    } else if (*p == '"' && strcmp(key, "color") == 0){
+      p = json_string(p, s->color, sizeof(s->color));
+    } else {
+      p = json_skip(p);
+    }
+    if (p == NULL){
+      return NULL;
+    }
+
+    p = json_ws(p);
+    if (*p == ','){
+      p = json_ws(p + 1);
+    } else if (*p != '}'){
+      return NULL;
+    }
+  }
+  return p + 1;
+}
+
+//Returns number of segments, or -1 if the line is not a block (protocol header, malformed...)
+static int parse_block(const char *line, StatusSegment *segments){
+  const char *p = json_ws(line);
+  int n = 0;
+
+  if (*p == ','){                     //Infinite array separator
+    p = json_ws(p + 1);
+  }
+
+  if (*p == '\0' || *p == '{'){       //Empty line or i3bar header {"version": 1}
+    return -1;
+  }
+
+  if (*p != '['){
+    memset(segments, 0, sizeof(StatusSegment));
+    snprintf(segments[0].text, sizeof(segments[0].text), "%.*s", (int) sizeof(segments[0].text) - 1, line);
+    return 1;
+  }
+
+  p = json_ws(p + 1);
+  if (*p == '\0'){                    //Opening line of the infinite array
+    return -1;
+  }
+  while (*p != ']'){
+    if (n == STATUS_FEED_MAX_SEGMENTS){
+      break;
+    }
+    if ((p = json_object(p, &segments[n])) == NULL){
+      return -1;
+    }
+    n++;
+    p = json_ws(p);
+    if (*p == ','){
+      p = json_ws(p + 1);
+    } else if (*p != ']'){
+      return -1;
+    }
+  }
+  return n;
+}
+
+//Replaces the feeder block. Returns true if it changed
+static bool feeder_update(StatusFeeder *f, StatusSegment *segments, int n){
+  if (n == f->nsegments && memcmp(segments, f->segments, n * sizeof(StatusSegment)) == 0){
+    return false;
+  }
+  memcpy(f->segments, segments, n * sizeof(StatusSegment));
+  f->nsegments = n;
+  return true;
+}
+
+//Only the status feed module runs again, the other modules keep their output
+static void feeder_redraw(void){
+  request_drawbars_modules(bar_modules_mask(BAR_MODULE_STATUSFEED));
+}
+
+static void feeder_close(StatusFeeder *f){
+  event_loop_unwatch(f->fd);
+  close(f->fd);
+  f->fd = -1;
+  if (f->nsegments > 0){
+    f->nsegments = 0;
+    feeder_redraw();
+  }
+}
+
+int status_feed_add(int fd, int pid){
+  StatusFeeder *f = NULL;
+
+  for (int i = 0; i < n_feeders; i++){
+    if (feeders[i].fd < 0){
+      f = &feeders[i];
+      break;
+    }
+  }
+  if (f == NULL){
+    if (n_feeders >= STATUS_FEED_MAX_FEEDERS){
+      return -1;
+    }
+    f = &feeders[n_feeders++];
+  }
+
+  memset(f, 0, sizeof(StatusFeeder));
+  f->fd = fd;
+  f->pid = pid;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  if (event_loop_watch(fd, POLLIN, status_feed_handler, f) < 0){
+    f->fd = -1;
+    return -1;
+  }
+  return 0;
+}
+
+//Reads whatever is available without blocking. A burst of blocks causes a single redraw
+void status_feed_handler(int fd, short revents, void *data){
+  StatusSegment segments[STATUS_FEED_MAX_SEGMENTS];
+  StatusFeeder *f = data;
+  char buffer[STATUS_FEED_LINELEN];
+  char *start, *nl;
+  bool complete = false;
+  ssize_t n;
+  int nseg;
+
+  for (;;){
+    n = read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR){
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN){
+      break;
+    }
+    if (n <= 0){                        //EOF or error: the feeder exited
+      feeder_close(f);
+      return;
+    }
+
+    for (start = buffer; start < buffer + n; start = nl + 1){
+      if ((nl = memchr(start, '\n', buffer + n - start)) == NULL){
+        nl = buffer + n;
+      }
+
+      if (!f->discarding){
+        if (f->linelen + (nl - start) >= STATUS_FEED_LINELEN){
+          f->discarding = true;
+        } else {
+          memcpy(f->line + f->linelen, start, nl - start);
+          f->linelen += nl - start;
+        }
+      }
+
+      if (nl == buffer + n){            //Line continues in the next read
+        break;
+      }
+
+      //Complete line
+      f->line[f->linelen] = '\0';
+      if (!f->discarding && (nseg = parse_block(f->line, segments)) >= 0){
+        complete = feeder_update(f, segments, nseg) || complete;
+      }
+      f->linelen = 0;
+      f->discarding = false;
+    }
+  }
+
+  if (complete){
+    feeder_redraw();
+  }
+}
+
+const char *status_feed_text(char *buffer, int size){
+  const char *color = NULL;
+  int len = 0;
+
+  buffer[0] = '\0';
+  for (int i = 0; i < n_feeders; i++){
+    for (int j = 0; j < feeders[i].nsegments; j++){
+      StatusSegment *s = &feeders[i].segments[j];
+      if (s->text[0] == '\0'){
+        continue;
+      }
+      if (color == NULL && s->color[0] == '#'){
+        color = s->color;
+      }
+      len += snprintf(buffer + len, size - len, "%s%s", len > 0 ? "  " : "", s->text);
+      if (len >= size){
+        return color;
+      }
+    }
+  }
+  return color;
+}
@@ -0,0 +1,235 @@
+#include <sysfs.h>
+#include <event_loop.h>
+#include <bar_modules.h>
+#include <helper_scripts.h>
+#include <power_policy.h>
+#include <proc_stats.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+static SysfsAttr sysfs_attrs[SYSFS_MAX_ATTRS];
+static int n_sysfs_attrs = 0;
+static pthread_mutex_t mutex_sysfs = PTHREAD_MUTEX_INITIALIZER;
+
+//Subsystems whose uevents trigger a bar refresh, of the module showing them
+static const char *uevent_subsystems[] = {"power_supply", "backlight", NULL};
+static const unsigned int uevent_modules[] = {BAR_MODULE_BATTERYSTATUS, BAR_MODULE_BRIGHTNESS};
+
+const char *sysfs_root(void){
+  static const char *root = NULL;
+  if (root == NULL && (root = getenv(SYSFS_ROOT_ENV)) == NULL){
+    root = SYSFS_DEFAULT_ROOT;
+  }
+  return root;
+}
+
+SysfsAttr *sysfs_attr_get_buffer(const char *path, char *buf, int size){
+  SysfsAttr *a = NULL;
+  int fd;
+
+  pthread_mutex_lock(&mutex_sysfs);
+  for (int i = 0; i < n_sysfs_attrs; i++){
+    if (strcmp(sysfs_attrs[i].path, path) == 0){
+      a = &sysfs_attrs[i];
+      goto sysfs_attr_get_end;
+    }
+  }
+
+  if (n_sysfs_attrs >= SYSFS_MAX_ATTRS || strlen(path) >= SYSFS_ATTR_PATHLEN){
+    goto sysfs_attr_get_end;
+  }
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0){
+    goto sysfs_attr_get_end;
+  }
+
+  a = &sysfs_attrs[n_sysfs_attrs++];
+  strcpy(a->path, path);
+  a->fd = fd;
+  a->valid = false;
+  a->buf = buf != NULL ? buf : a->value;
+  a->size = buf != NULL ? size : SYSFS_ATTR_VALUELEN;
+  a->buf[0] = '\0';
+
+  sysfs_attr_get_end:
+  pthread_mutex_unlock(&mutex_sysfs);
+  return a;
+}
+
+SysfsAttr *sysfs_attr_get(const char *path){
+  return sysfs_attr_get_buffer(path, NULL, 0);
+}
+
+static bool sysfs_attr_due(SysfsAttr *a, struct timespec *now){
+  return !a->valid || now->tv_sec - a->read_time.tv_sec >= SYSFS_ATTR_MAXAGE;
+}
+
+int sysfs_attr_read(SysfsAttr *a, char *buf, size_t size){
+  struct timespec now;
+  ssize_t n;
+
+  if (a == NULL){
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock(&mutex_sysfs);
+  if (sysfs_attr_due(a, &now)){
+    //sysfs attributes must be read from offset 0 to get a fresh value
+    n = pread(a->fd, a->buf, a->size - 1, 0);
+    if (n < 0){
+      a->valid = false;
+      pthread_mutex_unlock(&mutex_sysfs);
+      return -1;
+    }
+    a->buf[n] = '\0';
+    a->valid = true;
+    a->read_time = now;
+  }
+  //Copied under the lock: another thread may reread it right after
+  if (buf != NULL && size > 0){
+    snprintf(buf, size, "%s", a->buf);
+  }
+  pthread_mutex_unlock(&mutex_sysfs);
+
+  return 0;
+}
+
+int sysfs_attr_int(SysfsAttr *a){
+  char v[SYSFS_ATTR_VALUELEN];
+  return sysfs_attr_read(a, v, sizeof(v)) == 0 ? atoi(v) : 0;
+}
+
+float sysfs_attr_float(SysfsAttr *a){
+  char v[SYSFS_ATTR_VALUELEN];
+  return sysfs_attr_read(a, v, sizeof(v)) == 0 ? atof(v) : 0;
+}
+
+void sysfs_attr_refresh(void){
+  ReadRequest reqs[SYSFS_MAX_ATTRS];
+  SysfsAttr *due[SYSFS_MAX_ATTRS];
+  struct timespec now;
+  int n = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock(&mutex_sysfs);
+  for (int i = 0; i < n_sysfs_attrs; i++){
+    if (sysfs_attr_due(&sysfs_attrs[i], &now)){
+      due[n] = &sysfs_attrs[i];
+      reqs[n].fd = sysfs_attrs[i].fd;
+      reqs[n].buf = sysfs_attrs[i].buf;
+      reqs[n].len = sysfs_attrs[i].size - 1;
+      reqs[n].offset = 0;
+      reqs[n].no_ring = strncmp(sysfs_attrs[i].path, "/proc/", 6) == 0;
+      n++;
+    }
+  }
+
+  if (n > 0){
+    read_batch(reqs, n);
+  }
+
+  for (int i = 0; i < n; i++){
+    if (reqs[i].result < 0){
+      due[i]->valid = false;
+      due[i]->buf[0] = '\0';
+      continue;
+    }
+    due[i]->buf[reqs[i].result] = '\0';
+    due[i]->valid = true;
+    due[i]->read_time = now;
+  }
+  pthread_mutex_unlock(&mutex_sysfs);
+}
+
+void sysfs_attr_invalidate(const char *prefix){
+  size_t len = strlen(prefix);
+
+  pthread_mutex_lock(&mutex_sysfs);
+  for (int i = 0; i < n_sysfs_attrs; i++){
+    if (strncmp(sysfs_attrs[i].path, prefix, len) == 0){
+      sysfs_attrs[i].valid = false;
+    }
+  }
+  pthread_mutex_unlock(&mutex_sysfs);
+}
+
+int sysfs_uevent_open(void){
+  struct sockaddr_nl addr;
+  int fd;
+
+  fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+  if (fd < 0){
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_pid = 0;
+  addr.nl_groups = 1;   //Kernel uevent multicast group
+
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0){
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+void sysfs_uevent_handler(int fd, short revents, void *data){
+  char buffer[8192];
+  char prefix[SYSFS_ATTR_PATHLEN];
+  const char *subsystem, *devname, *line;
+  unsigned int refresh = 0;
+  bool power = false;
+  ssize_t n;
+
+  while ((n = recv(fd, buffer, sizeof(buffer) - 1, 0)) > 0){
+    buffer[n] = '\0';
+    subsystem = NULL;
+    devname = NULL;
+
+    //Message is "action@devpath" followed by NUL separated KEY=VALUE pairs
+    for (line = buffer; line < buffer + n; line += strlen(line) + 1){
+      if (strncmp(line, "SUBSYSTEM=", 10) == 0){
+        subsystem = line + 10;
+      } else if (strncmp(line, "DEVPATH=", 8) == 0){
+        devname = strrchr(line, '/');
+      }
+    }
+
+    if (subsystem == NULL || devname == NULL){
+      continue;
+    }
+
+    //Partitions come and go with disks. Which /proc/diskstats devices are whole disks is found out again
+    if (strcmp(subsystem, "block") == 0){
+      proc_stats_block_changed();
+    }
+
+    for (int i = 0; uevent_subsystems[i] != NULL; i++){
+      if (strcmp(subsystem, uevent_subsystems[i]) == 0){
+        snprintf(prefix, sizeof(prefix), "%s/class/%s%s/", sysfs_root(), subsystem, devname);
+        sysfs_attr_invalidate(prefix);
+        refresh |= bar_modules_mask(uevent_modules[i]);
+        power = power || strcmp(subsystem, "power_supply") == 0;
+      }
+    }
+  }
+
+  //AC adapter plugged or unplugged
+  if (power){
+    power_policy_check();
+  }
+  if (refresh){
+    request_drawbars_modules(refresh);
+  }
+}
@@ -0,0 +1,317 @@
+//close_range()
+#define _GNU_SOURCE
+
+#include <zygote.h>
+#include <spawn_programs.h>
+#include <children.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <stddef.h>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+#define HAVE_CLOSE_RANGE
+#endif
+
+//How each of stdin, stdout and stderr is set up
+enum {ZygoteInherit, ZygoteFd, ZygoteDevNull};
+
+typedef struct ZygoteRequest {
+  int32_t stdio[3];                   //ZygoteInherit, ZygoteFd or ZygoteDevNull
+  int32_t wait;                       //Send the exit status too
+  char argv[ZYGOTE_ARGV_MAX];
+} ZygoteRequest;
+
+typedef struct ZygoteReply {
+  int32_t pid;                        //-errno if it couldn't start
+  int32_t status;
+  ChildUsage usage;
+} ZygoteReply;
+
+typedef struct ZygoteWaiting {
+  pid_t pid;
+  int reply_fd;
+} ZygoteWaiting;
+
+static int zygote_sock = -1;
+
+//HELPER PROCESS
+static ZygoteWaiting waiting[ZYGOTE_MAX_WAITING];
+static int nwaiting = 0;
+
+static void zygote_reply(int fd, pid_t pid, int status, const struct rusage *ru){
+  ZygoteReply r;
+
+  memset(&r, 0, sizeof(r));
+  r.pid = pid;
+  r.status = status;
+  if (ru != NULL){
+    r.usage.utime_us = ru->ru_utime.tv_sec * 1000000LL + ru->ru_utime.tv_usec;
+    r.usage.stime_us = ru->ru_stime.tv_sec * 1000000LL + ru->ru_stime.tv_usec;
+    r.usage.maxrss_kb = ru->ru_maxrss;
+  }
+  write(fd, &r, sizeof(r));
+}
+
+static void zygote_handle_request(int sock){
+  char control[CMSG_SPACE(4 * sizeof(int))];
+  const char *argv[ZYGOTE_ARGV_MAX / 2 + 1];
+  int fds[4], stdio[3], nfds = 0, argc = 0;
+  struct cmsghdr *cmsg;
+  struct msghdr msg;
+  struct iovec iov;
+  ZygoteRequest req;
+  ssize_t n;
+  pid_t pid;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &req;
+  iov.iov_len = sizeof(req);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  if ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) <= 0){
+    if (n == 0 || (errno != EINTR && errno != EAGAIN)){
+      _exit(0);                       //The WM is gone
+    }
+    return;
+  }
+
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){
+      nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+    }
+  }
+  if (nfds < 1){
+    return;
+  }
+
+  //fds: reply pipe, then one per ZygoteFd in stdio order
+  for (int i = 0, next = 1; i < 3; i++){
+    stdio[i] = req.stdio[i] == ZygoteDevNull ? SPAWN_DEVNULL : SPAWN_INHERIT;
+    if (req.stdio[i] == ZygoteFd && next < nfds){
+      stdio[i] = fds[next++];
+    }
+  }
+
+  req.argv[sizeof(req.argv) - 1] = '\0';
+  for (char *a = req.argv; *a != '\0' && a < req.argv + n - sizeof(int32_t) * 4; a += strlen(a) + 1){
+    argv[argc++] = a;
+  }
+  argv[argc] = NULL;
+
+  pid = argc > 0 ? spawn_launch_local(argv, stdio[0], stdio[1], stdio[2]) : -1;
+  zygote_reply(fds[0], pid < 0 ? -errno : pid, 0, NULL);
+  for (int i = 1; i < nfds; i++){
+    close(fds[i]);
+  }
+
+  if (pid > 0 && req.wait && nwaiting < ZYGOTE_MAX_WAITING){
+    waiting[nwaiting].pid = pid;
+    waiting[nwaiting].reply_fd = fds[0];
+    nwaiting++;
+  } else {
+    close(fds[0]);                    //Waiters see EOF
+  }
+}
+
+static void zygote_reap(int sfd){
+  struct signalfd_siginfo si;
+  struct rusage ru;
+  int status;
+  pid_t pid;
+
+  while (read(sfd, &si, sizeof(si)) > 0);
+
+  while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0){
+    for (int i = 0; i < nwaiting; i++){
+      if (waiting[i].pid == pid){
+        zygote_reply(waiting[i].reply_fd, pid, status, &ru);
+        close(waiting[i].reply_fd);
+        waiting[i] = waiting[--nwaiting];
+        break;
+      }
+    }
+  }
+}
+
+static void zygote_main(int sock){
+  struct pollfd pfds[2];
+  sigset_t chld;
+  int sfd;
+
+  prctl(PR_SET_NAME, "horizonwm-spawn");
+
+  //Children are reaped from the poll loop. Replies to a waiter that went away must not kill us
+  sigemptyset(&chld);
+  sigaddset(&chld, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &chld, NULL);
+  signal(SIGCHLD, SIG_DFL);
+  signal(SIGPIPE, SIG_IGN);
+  if ((sfd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC)) < 0){
+    _exit(1);
+  }
+
+  pfds[0].fd = sock;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = sfd;
+  pfds[1].events = POLLIN;
+
+  for (;;){
+    if (poll(pfds, 2, -1) < 0){
+      continue;
+    }
+    if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)){
+      zygote_handle_request(sock);
+    }
+    if (pfds[1].revents & POLLIN){
+      zygote_reap(sfd);
+    }
+  }
+}
+
+//WM
+int zygote_start(void){
+  int sv[2];
+  pid_t pid;
+
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0){
+    return -1;
+  }
+
+  if ((pid = fork()) < 0){
+    close(sv[0]);
+    close(sv[1]);
+    return -1;
+  }
+
+  if (pid == 0){
+    //Nothing of the WM but the socket: X connection, fonts...
+    if (sv[1] != 3){
+      dup2(sv[1], 3);
+    }
+    fcntl(3, F_SETFD, FD_CLOEXEC);
+#ifdef HAVE_CLOSE_RANGE
+    close_range(4, ~0U, 0);
+#else
+    for (int fd = sysconf(_SC_OPEN_MAX) - 1; fd > 3; fd--){
+      close(fd);
+    }
+#endif
+    zygote_main(3);
+  }
+
+  close(sv[1]);
+  zygote_sock = sv[0];
+  return 0;
+}
+
+pid_t zygote_spawn(const char *const argv[], int in, int out, int err, int *status_fd){
+  char control[CMSG_SPACE(4 * sizeof(int))];
+  const int stdio[3] = {in, out, err};
+  int reply[2], fds[4], nfds = 0;
+  struct cmsghdr *cmsg;
+  struct msghdr msg;
+  struct iovec iov;
+  ZygoteRequest req;
+  ZygoteReply r;
+  size_t len = 0, l;
+
+  if (zygote_sock < 0){
+    return ZYGOTE_DOWN;
+  }
+
+  memset(&req, 0, sizeof(req));
+  for (int i = 0; argv[i] != NULL; i++){
+    if ((l = strlen(argv[i]) + 1) + len >= sizeof(req.argv)){
+      return ZYGOTE_DOWN;
+    }
+    memcpy(req.argv + len, argv[i], l);
+    len += l;
+  }
+  req.argv[len++] = '\0';
+  req.wait = status_fd != NULL;
+
+  if (pipe(reply) < 0){
+    return ZYGOTE_DOWN;
+  }
+  fcntl(reply[0], F_SETFD, FD_CLOEXEC);
+  fcntl(reply[1], F_SETFD, FD_CLOEXEC);
+
+  fds[nfds++] = reply[1];
+  for (int i = 0; i < 3; i++){
+    if (stdio[i] >= 0){
+      req.stdio[i] = ZygoteFd;
+      fds[nfds++] = stdio[i];
+    } else {
+      req.stdio[i] = stdio[i] == SPAWN_DEVNULL ? ZygoteDevNull : ZygoteInherit;
+    }
+  }
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &req;
+  iov.iov_len = offsetof(ZygoteRequest, argv) + len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+
+  //Datagrams: concurrent requests from several threads never interleave
+  if (sendmsg(zygote_sock, &msg, MSG_NOSIGNAL) < 0){
+    close(reply[0]);
+    close(reply[1]);
+    return ZYGOTE_DOWN;
+  }
+  close(reply[1]);
+
+  if (read(reply[0], &r, sizeof(r)) != sizeof(r)){
+    close(reply[0]);
+    return ZYGOTE_DOWN;
+  }
+  if (r.pid < 0){
+    close(reply[0]);
+    errno = -r.pid;
+    return -1;
+  }
+
+  if (status_fd != NULL){
+    *status_fd = reply[0];
+  } else {
+    close(reply[0]);
+  }
+  return r.pid;
+}
+
+int zygote_wait(int status_fd, ChildUsage *usage){
+  ZygoteReply r;
+  ssize_t n;
+
+  while ((n = read(status_fd, &r, sizeof(r))) < 0 && errno == EINTR);
+  close(status_fd);
+  if (n != sizeof(r)){
+    return -1;
+  }
+  if (usage){
+    *usage = r.usage;
+  }
+  return r.status;
+}